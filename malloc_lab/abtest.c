@@ -0,0 +1,209 @@
+/*
+ * abtest.c - Tell whether two builds of mdriver differ in throughput
+ *            by more than the noise.
+ *
+ * usage: abtest [-r <rounds>] [-n <runs>] <mdriverA> <mdriverB> [<args>]
+ *
+ * Runs "mdriverX -S runs -O file args" for A and B in turn, rounds
+ * times, swapping which goes first from one round to the next so that
+ * a drift in the machine's speed falls on both alike. Then, for each
+ * trace and for all of them together, it prints the median throughput
+ * of A and B, the change from A to B with its confidence interval
+ * (see fstats.h), and a "*" where the interval excludes 0. For
+ * example, to test mm-tlsf.c against mm.c:
+ *
+ *   unix> ./abtest ./mdriver ./mdriver-tlsf -t traces0/
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/wait.h>
+
+#include "fstats.h"
+
+#define MAXLINE   1024
+#define MAXTRACES  256  /* max traces compared */
+#define MAXARGS    256  /* max args passed on to mdriver */
+#define MAXRUNS   1000  /* max runs of each build, over all rounds */
+#define ROUNDS       5  /* default rounds */
+#define RUNS        10  /* default timed replays per trace per round */
+
+/* The samples of one build */
+typedef struct {
+    double ops[MAXTRACES];   /* ops in each trace, 0 if never valid */
+    double *secs[MAXTRACES]; /* secs of its replays, one per run */
+    int nruns;               /* runs so far, over all rounds */
+} side_t;
+
+static void die(char *msg, char *arg)
+{
+    fprintf(stderr, "abtest: %s %s\n", msg, arg);
+    exit(1);
+}
+
+static void usage(void)
+{
+    fprintf(stderr, "usage: abtest [-r <rounds>] [-n <runs>] "
+	    "<mdriverA> <mdriverB> [<mdriver args>]\n");
+    exit(1);
+}
+
+/*
+ * run - Run one round of mdriver, with its output thrown away, and add
+ *     the replay times it writes to side s
+ */
+static void run(char *mdriver, char **args, int nargs, int runs, side_t *s)
+{
+    char path[] = "/tmp/abtestXXXXXX", nbuf[16], line[MAXLINE];
+    char *argv[MAXARGS + 6];
+    int fd, status, i, t, r;
+    double ops, secs;
+    FILE *fp;
+    pid_t pid;
+
+    if ((fd = mkstemp(path)) < 0)
+	die("could not create", path);
+    close(fd);
+    sprintf(nbuf, "%d", runs);
+    argv[0] = mdriver;
+    argv[1] = "-S";
+    argv[2] = nbuf;
+    argv[3] = "-O";
+    argv[4] = path;
+    for (i = 0; i < nargs; i++)
+	argv[5 + i] = args[i];
+    argv[5 + nargs] = NULL;
+
+    fflush(stdout);
+    if ((pid = fork()) < 0)
+	die("could not fork for", mdriver);
+    if (pid == 0) {
+	if ((fd = open("/dev/null", O_WRONLY)) >= 0)
+	    dup2(fd, 1);
+	execv(mdriver, argv);
+	_exit(127);
+    }
+    if (waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) ||
+	WEXITSTATUS(status) != 0) {
+	unlink(path);
+	die("failed (run it alone to see why):", mdriver);
+    }
+
+    if ((fp = fopen(path, "r")) == NULL)
+	die("could not read", path);
+    if (fgets(line, MAXLINE, fp) == NULL)
+	die("no samples from", mdriver);
+    while (fgets(line, MAXLINE, fp) != NULL) {
+	if (sscanf(line, "%d,%lf,%d,%lf", &t, &ops, &r, &secs) != 4 ||
+	    t < 0 || t >= MAXTRACES || r < 0 || r >= runs)
+	    die("bad sample line from", mdriver);
+	if (s->secs[t] == NULL &&
+	    (s->secs[t] = calloc(MAXRUNS, sizeof(double))) == NULL)
+	    die("out of memory for", mdriver);
+	s->ops[t] = ops;
+	s->secs[t][s->nruns + r] = secs;
+    }
+    fclose(fp);
+    unlink(path);
+    s->nruns += runs;
+}
+
+/*
+ * kops - The throughput of each run of trace t (or of all the traces
+ *     that both sides ran, when t < 0) in kops[]
+ */
+static void kops(side_t *s, side_t *other, int t, double *kops)
+{
+    double ops, secs;
+    int i, j;
+
+    for (j = 0; j < s->nruns; j++) {
+	ops = secs = 0;
+	for (i = 0; i < MAXTRACES; i++)
+	    if ((t < 0 || i == t) && s->secs[i] && other->secs[i]) {
+		ops += s->ops[i];
+		secs += s->secs[i][j];
+	    }
+	kops[j] = ops / secs / 1e3;
+    }
+}
+
+/*
+ * compare - Print the line of trace t (all traces when t < 0)
+ */
+static void compare(side_t *a, side_t *b, int t)
+{
+    double *ka, *kb, change, lo, hi;
+    fstats_t sa, sb;
+    int sig;
+
+    ka = malloc(a->nruns * sizeof(double));
+    kb = malloc(b->nruns * sizeof(double));
+    if (ka == NULL || kb == NULL)
+	die("out of memory", "");
+    kops(a, b, t, ka);
+    kops(b, a, t, kb);
+    fstats(ka, a->nruns, &sa);
+    fstats(kb, b->nruns, &sb);
+    sig = fstats_compare(ka, a->nruns, kb, b->nruns, &change, &lo, &hi);
+    if (t < 0)
+	printf("%5s", "Total");
+    else
+	printf("%2d   ", t);
+    printf("%9.0f%9.0f%+9.1f%%  [%+6.1f%%, %+6.1f%%] %s\n", sa.median,
+	   sb.median, 100 * change, 100 * lo, 100 * hi, sig ? "*" : "");
+    free(ka);
+    free(kb);
+}
+
+int main(int argc, char **argv)
+{
+    static side_t a, b;
+    int rounds = ROUNDS, runs = RUNS;
+    int c, i, t;
+
+    while ((c = getopt(argc, argv, "+r:n:")) != EOF) {
+	switch (c) {
+	case 'r':
+	    rounds = atoi(optarg);
+	    break;
+	case 'n':
+	    runs = atoi(optarg);
+	    break;
+	default:
+	    usage();
+	}
+    }
+    if (argc - optind < 2 || argc - optind - 2 > MAXARGS ||
+	rounds < 1 || runs < 1 || rounds * runs > MAXRUNS)
+	usage();
+
+    for (i = 0; i < rounds; i++) {
+	fprintf(stderr, "round %d of %d\r", i + 1, rounds);
+	if (i % 2 == 0) {
+	    run(argv[optind], argv + optind + 2, argc - optind - 2, runs, &a);
+	    run(argv[optind + 1], argv + optind + 2, argc - optind - 2, runs, &b);
+	} else {
+	    run(argv[optind + 1], argv + optind + 2, argc - optind - 2, runs, &b);
+	    run(argv[optind], argv + optind + 2, argc - optind - 2, runs, &a);
+	}
+    }
+    fprintf(stderr, "\n");
+
+    printf("Throughput in Kops, A = %s, B = %s, %d runs each\n",
+	   argv[optind], argv[optind + 1], a.nruns);
+    printf("%5s%9s%9s%10s  %4.0f%% CI\n", "trace", "A", "B", "change",
+	   FSTATS_CONF * 100);
+    for (t = 0; t < MAXTRACES; t++)
+	if (a.secs[t] && b.secs[t])
+	    compare(&a, &b, t);
+	else if (a.secs[t] || b.secs[t])
+	    printf("%2d   %9s%9s  (invalid on one side)\n", t,
+		   a.secs[t] ? "" : "-", b.secs[t] ? "" : "-");
+    compare(&a, &b, -1);
+    printf("* the change is significant at the %.0f%% level\n",
+	   FSTATS_CONF * 100);
+    return 0;
+}
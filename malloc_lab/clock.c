@@ -1,6 +1,6 @@
 /* 
- * clock.c - Routines for using the cycle counters on x86, 
- *           Alpha, and Sparc boxes.
+ * clock.c - Routines for using the cycle counters on x86 and Alpha
+ *           boxes, and a nanosecond clock everywhere else.
  * 
  * Copyright (c) 2002, R. Bryant and D. O'Hallaron, All rights reserved.
  * May not be used, modified, or copied without permission.
@@ -9,7 +9,11 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
+#include <time.h>
 #include <sys/times.h>
+#if defined(__i386__) || defined(__x86_64__)
+#include <cpuid.h>
+#endif
 #include "clock.h"
 
 
@@ -21,55 +25,105 @@
  * You can verify this for yourself using gcc -v.
  *******************************************************/
 
-#if defined(__i386__)  
+#if defined(__i386__) || defined(__x86_64__)
 /*******************************************************
- * Pentium versions of start_counter() and get_counter()
+ * x86 versions of start_counter() and get_counter()
+ *
+ * The time stamp counter is used only if it is invariant (it ticks
+ * at a constant rate whatever the power state of the core) and
+ * rdtscp exists; otherwise the counter counts nanoseconds of
+ * CLOCK_MONOTONIC_RAW instead, and mhz() returns 1000. Reads are
+ * serialized with lfence, so that the instructions being timed can
+ * neither start before the first read nor finish after the second.
  *******************************************************/
 
-
 /* $begin x86cyclecounter */
-/* Initialize the cycle counter */
-static unsigned cyc_hi = 0;
-static unsigned cyc_lo = 0;
+static unsigned long long cyc_start = 0;
+static int cyc_ok = -1;  /* counter counts cycles (else ns)? -1 until known */
+
+/* Nanoseconds of the raw monotonic clock */
+static unsigned long long ns_counter(void)
+{
+    struct timespec ts;
 
+    clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
 
-/* Set *hi and *lo to the high and low order bits  of the cycle counter.  
-   Implementation requires assembly code to use the rdtsc instruction. */
-void access_counter(unsigned *hi, unsigned *lo)
+/* Is the TSC invariant, and is there an rdtscp instruction? */
+static int check_tsc(void)
 {
-    asm("rdtsc; movl %%edx,%0; movl %%eax,%1"   /* Read cycle counter */
-	: "=r" (*hi), "=r" (*lo)                /* and move results to */
-	: /* No input */                        /* the two outputs */
-	: "%edx", "%eax");
+    unsigned a, b, c, d;
+
+    if (!__get_cpuid(0x80000001, &a, &b, &c, &d) || !(d & (1u << 27)))
+	return 0;
+    if (!__get_cpuid(0x80000007, &a, &b, &c, &d) || !(d & (1u << 8)))
+	return 0;
+    return 1;
+}
+
+/* Read the counter before the code being timed */
+static unsigned long long counter_begin(void)
+{
+    unsigned hi, lo;
+
+    if (cyc_ok < 0)
+	cyc_ok = check_tsc();
+    if (!cyc_ok)
+	return ns_counter();
+    asm volatile("lfence; rdtsc; lfence" : "=a" (lo), "=d" (hi) : : "memory");
+    return ((unsigned long long)hi << 32) | lo;
+}
+
+/* Read the counter after the code being timed */
+static unsigned long long counter_end(void)
+{
+    unsigned hi, lo;
+
+    if (!cyc_ok)
+	return ns_counter();
+    asm volatile("rdtscp; lfence" : "=a" (lo), "=d" (hi) : : "ecx", "memory");
+    return ((unsigned long long)hi << 32) | lo;
 }
 
 /* Record the current value of the cycle counter. */
 void start_counter()
 {
-    access_counter(&cyc_hi, &cyc_lo);
+    cyc_start = counter_begin();
 }
 
 /* Return the number of cycles since the last call to start_counter. */
 double get_counter()
 {
-    unsigned ncyc_hi, ncyc_lo;
-    unsigned hi, lo, borrow;
-    double result;
-
-    /* Get cycle counter */
-    access_counter(&ncyc_hi, &ncyc_lo);
+    return (double)(counter_end() - cyc_start);
+}
+/* $end x86cyclecounter */
 
-    /* Do double precision subtraction */
-    lo = ncyc_lo - cyc_lo;
-    borrow = lo > ncyc_lo;
-    hi = ncyc_hi - cyc_hi - borrow;
-    result = (double) hi * (1 << 30) * 4 + lo;
-    if (result < 0) {
-	fprintf(stderr, "Error: counter returns neg value: %.0f\n", result);
+/*
+ * kernel_mhz - The TSC rate as the kernel or the processor states it:
+ *     sysfs tsc_freq_khz where the kernel exports it, else cpuid leaf
+ *     0x15 (crystal clock times the TSC/crystal ratio). 0 if neither.
+ */
+static double kernel_mhz(void)
+{
+    FILE *fp;
+    unsigned long khz;
+    unsigned a, b, c, d;
+
+    if ((fp = fopen("/sys/devices/system/cpu/cpu0/tsc_freq_khz", "r")) != NULL) {
+	if (fscanf(fp, "%lu", &khz) == 1 && khz > 0) {
+	    fclose(fp);
+	    return khz / 1e3;
+	}
+	fclose(fp);
     }
-    return result;
+    if (__get_cpuid_max(0, NULL) >= 0x15) {
+	__cpuid(0x15, a, b, c, d);
+	if (a && b && c)
+	    return (double)c * b / a / 1e6;
+    }
+    return 0;
 }
-/* $end x86cyclecounter */
 
 #elif defined(__alpha)
 
@@ -80,6 +134,7 @@ double get_counter()
 /* Initialize the cycle counter */
 static unsigned cyc_hi = 0;
 static unsigned cyc_lo = 0;
+static int cyc_ok = 1;
 
 
 /* Use Alpha cycle timer to compute cycles.  Then use
@@ -133,30 +188,43 @@ double get_counter()
     return result;
 }
 
+static double kernel_mhz(void)
+{
+    return 0;
+}
+
 #else
 
 /****************************************************************
- * All the other platforms for which we haven't implemented cycle
- * counter routines. Newer models of sparcs (v8plus) have cycle
- * counters that can be accessed from user programs, but since there
- * are still many sparc boxes out there that don't support this, we
- * haven't provided a Sparc version here.
+ * All the other platforms: the counter counts nanoseconds of
+ * CLOCK_MONOTONIC_RAW, which no clock adjustment can disturb, and
+ * mhz() returns 1000.
  ***************************************************************/
 
+static unsigned long long cyc_start = 0;
+static int cyc_ok = 0;  /* the counter counts nanoseconds */
+
+static unsigned long long ns_counter(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
 void start_counter()
 {
-    printf("ERROR: You are trying to use a start_counter routine in clock.c\n");
-    printf("that has not been implemented yet on this platform.\n");
-    printf("Please choose another timing package in config.h.\n");
-    exit(1);
+    cyc_start = ns_counter();
 }
 
 double get_counter() 
 {
-    printf("ERROR: You are trying to use a get_counter routine in clock.c\n");
-    printf("that has not been implemented yet on this platform.\n");
-    printf("Please choose another timing package in config.h.\n");
-    exit(1);
+    return (double)(ns_counter() - cyc_start);
+}
+
+static double kernel_mhz(void)
+{
+    return 0;
 }
 #endif
 
@@ -181,24 +249,37 @@ double ovhd()
 
 /* $begin mhz */
 /* Estimate the clock rate by measuring the cycles that elapse */ 
-/* while sleeping for sleeptime seconds */
+/* while CLOCK_MONOTONIC_RAW advances by sleeptime seconds */
 double mhz_full(int verbose, int sleeptime)
 {
-    double rate;
+    struct timespec t0, t1;
+    double cycles, secs;
 
     start_counter();
+    clock_gettime(CLOCK_MONOTONIC_RAW, &t0);
     sleep(sleeptime);
-    rate = get_counter() / (1e6*sleeptime);
+    clock_gettime(CLOCK_MONOTONIC_RAW, &t1);
+    cycles = get_counter();
+    secs = (t1.tv_sec - t0.tv_sec) + 1e-9 * (t1.tv_nsec - t0.tv_nsec);
     if (verbose) 
-	printf("Processor clock rate ~= %.1f MHz\n", rate);
-    return rate;
+	printf("Processor clock rate ~= %.1f MHz\n", cycles / (1e6*secs));
+    return cycles / (1e6*secs);
 }
 /* $end mhz */
 
-/* Version using a default sleeptime */
+/* The rate the kernel states if it does, else measure it for a second */
 double mhz(int verbose)
 {
-    return mhz_full(verbose, 2);
+    double rate;
+
+    start_counter();      /* settles cyc_ok */
+    if (!cyc_ok)
+	rate = 1000;      /* the counter counts nanoseconds */
+    else if ((rate = kernel_mhz()) == 0)
+	return mhz_full(verbose, 1);
+    if (verbose)
+	printf("Processor clock rate = %.1f MHz\n", rate);
+    return rate;
 }
 
 /** Special counters that compensate for timer interrupt overhead */
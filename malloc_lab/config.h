@@ -53,20 +53,21 @@
 #define UTIL_WEIGHT .60
 
 /* 
- * Alignment requirement in bytes (either 4 or 8) 
+ * Alignment requirement in bytes (4, 8 or 16) 
  */
-#define ALIGNMENT 8  
+#define ALIGNMENT 16  
 
 /* 
- * Maximum heap size in bytes 
+ * Maximum heap size in bytes, unless mdriver -M says otherwise
  */
 #define MAX_HEAP (20*(1<<20))  /* 20 MB */
 
 /*****************************************************************************
  * Set exactly one of these USE_xxx constants to "1" to select a timing method
  *****************************************************************************/
-#define USE_FCYC   0   /* cycle counter w/K-best scheme (x86 & Alpha only) */
+#define USE_FCYC   1   /* cycle counter w/K-best scheme (invariant TSC on x86,
+			  else CLOCK_MONOTONIC_RAW) */
 #define USE_ITIMER 0   /* interval timer (any Unix box) */
-#define USE_GETTOD 1   /* gettimeofday (any Unix box) */
+#define USE_GETTOD 0   /* gettimeofday (any Unix box) */
 
 #endif /* __CONFIG_H */
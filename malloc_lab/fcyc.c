@@ -38,11 +38,6 @@ static int samplecount = 0;
 
 /* for debugging only */
 #define KEEP_VALS 0
-#define KEEP_SAMPLES 0
-
-#if KEEP_SAMPLES
-static double *samples = NULL;
-#endif
 
 /* 
  * init_sampler - Start new sampling process 
@@ -52,12 +47,6 @@ static void init_sampler()
     if (values)
 	free(values);
     values = calloc(kbest, sizeof(double));
-#if KEEP_SAMPLES
-    if (samples)
-	free(samples);
-    /* Allocate extra for wraparound analysis */
-    samples = calloc(maxsamples+kbest, sizeof(double));
-#endif
     samplecount = 0;
 }
 
@@ -74,9 +63,6 @@ static void add_sample(double val)
 	pos = kbest-1;
 	values[pos] = val;
     }
-#if KEEP_SAMPLES
-    samples[samplecount] = val;
-#endif
     samplecount++;
     /* Insertion sort */
     while (pos > 0 && values[pos-1] > values[pos]) {
@@ -167,6 +153,30 @@ double fcyc(test_funct f, void *argp)
     return result;  
 }
 
+/*
+ * fcyc_samples - Time n runs of f, and store the cycles of each run in
+ *     samples[0..n-1], instead of keeping only the K best. For callers
+ *     that want the spread of the runs as well as their minimum.
+ */
+void fcyc_samples(test_funct f, void *argp, int n, double *samples)
+{
+    int i;
+
+    for (i = 0; i < n; i++) {
+	if (clear_cache)
+	    clear();
+	if (compensate) {
+	    start_comp_counter();
+	    f(argp);
+	    samples[i] = get_comp_counter();
+	} else {
+	    start_counter();
+	    f(argp);
+	    samples[i] = get_counter();
+	}
+    }
+}
+
 
 /*************************************************************
  * Set the various parameters used by the measurement routines 
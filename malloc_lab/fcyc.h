@@ -13,6 +13,9 @@ typedef void (*test_funct)(void *);
 /* Compute number of cycles used by test function f */
 double fcyc(test_funct f, void* argp);
 
+/* Store the number of cycles of each of n runs in samples[] */
+void fcyc_samples(test_funct f, void *argp, int n, double *samples);
+
 /*********************************************************
  * Set the various parameters used by measurement routines 
  *********************************************************/
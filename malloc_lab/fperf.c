@@ -0,0 +1,101 @@
+/*
+ * fperf.c - Count the hardware events used by a function f
+ *
+ * Each event is a separate perf_event_open counter on the calling
+ * thread, user mode only, so that the counters work at the default
+ * perf_event_paranoid setting. They are started and stopped together
+ * with prctl. When there are more events than hardware counters, the
+ * kernel time-slices them; each count is then scaled up by the
+ * fraction of the time the event was actually counted.
+ *
+ * Counters are opened on first use in each process, so a child made by
+ * fork (mdriver -j) counts its own events. An event the machine does
+ * not have, e.g. in a virtual machine without a PMU, is left out.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/prctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include "fperf.h"
+
+#define CACHE_MISS(cache) \
+    ((cache) | (PERF_COUNT_HW_CACHE_OP_READ << 8) | \
+     (PERF_COUNT_HW_CACHE_RESULT_MISS << 16))
+
+char *fperf_names[FPERF_EVENTS] = {
+    "cycles", "instrs", "L1d-miss", "LLC-miss", "dTLB-miss", "br-miss",
+    "faults"
+};
+
+static struct {
+    unsigned int type;
+    unsigned long long config;
+} events[FPERF_EVENTS] = {
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+    {PERF_TYPE_HW_CACHE, CACHE_MISS(PERF_COUNT_HW_CACHE_L1D)},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+    {PERF_TYPE_HW_CACHE, CACHE_MISS(PERF_COUNT_HW_CACHE_DTLB)},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+    {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS},
+};
+
+static int fds[FPERF_EVENTS];  /* counter of each event, -1 if none */
+static pid_t fds_pid;          /* process the counters belong to */
+
+/*
+ * open_counters - Open a disabled counter for each event the machine
+ *     has, on the calling thread
+ */
+static void open_counters(void)
+{
+    struct perf_event_attr attr;
+    int i;
+
+    for (i = 0; i < FPERF_EVENTS; i++) {
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = events[i].type;
+	attr.config = events[i].config;
+	attr.disabled = 1;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+	attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED |
+	    PERF_FORMAT_TOTAL_TIME_RUNNING;
+	fds[i] = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+    }
+    fds_pid = getpid();
+}
+
+int fperf(fperf_test_funct f, void *argp, int n, double *counts)
+{
+    unsigned long long val[3];  /* count, time enabled, time running */
+    int i, counted = 0;
+
+    if (fds_pid != getpid())
+	open_counters();
+
+    for (i = 0; i < FPERF_EVENTS; i++)
+	if (fds[i] >= 0)
+	    ioctl(fds[i], PERF_EVENT_IOC_RESET, 0);
+    prctl(PR_TASK_PERF_EVENTS_ENABLE);
+    for (i = 0; i < n; i++)
+	f(argp);
+    prctl(PR_TASK_PERF_EVENTS_DISABLE);
+
+    for (i = 0; i < FPERF_EVENTS; i++) {
+	counts[i] = -1;
+	if (fds[i] < 0 || read(fds[i], val, sizeof(val)) != sizeof(val) ||
+	    (val[2] == 0 && val[1] > 0))   /* never got a counter */
+	    continue;
+	if (val[2] > 0 && val[2] < val[1])  /* time-sliced: scale up */
+	    counts[i] = (double)val[0] * val[1] / val[2] / n;
+	else
+	    counts[i] = (double)val[0] / n;
+	counted++;
+    }
+    return counted;
+}
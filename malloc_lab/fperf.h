@@ -0,0 +1,17 @@
+/*
+ * fperf.h - Count hardware events (cycles, instructions, cache, TLB
+ *           and branch misses) used by a function f, with the Linux
+ *           perf_event_open interface
+ */
+#define FPERF_EVENTS 7
+
+/* The test function takes a generic pointer as input */
+typedef void (*fperf_test_funct)(void *);
+
+/* Short names of the events, for table headings */
+extern char *fperf_names[FPERF_EVENTS];
+
+/* Count the events of n runs of f(argp) and store the average per
+   run in counts[]; events the machine cannot count are set to -1.
+   Returns the number of events counted. */
+int fperf(fperf_test_funct f, void *argp, int n, double *counts);
@@ -0,0 +1,206 @@
+/*
+ * fragview.c - Show the heap snapshots that mdriver -F writes as text
+ *              charts, and point out the stretches of ops that
+ *              fragmented the heap the most.
+ *
+ * usage: fragview [-t <trace>] [-r <rows>] [-w <n>] <snapfile>
+ *
+ * For each trace it prints one row per snapshot (at most rows rows, 40
+ * by default, skipping evenly between them): the footprint, the free
+ * bytes, the external fragmentation 1 - largest/free, the largest free
+ * block, the padding inside live blocks, and a strip with one column
+ * per power of two of block size, from FIRST_LOG2 up, whose character
+ * shows the share of the free bytes in blocks of that size:
+ *
+ *     ' ' none  '.' < 5%  ':' < 15%  '-' < 30%  '=' < 50%  '+' < 70%
+ *     '*' < 85%  '#' more
+ *
+ * It then lists the n (by default 5) intervals between snapshots over
+ * which the fragmented free bytes, free - largest, grew the most. Those
+ * are the op ranges to look at in the trace.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define MAXLINE    (1<<16)
+#define ROWS       40   /* default max rows per trace */
+#define WORST       5   /* default intervals listed per trace */
+#define FIRST_LOG2  4   /* smallest power of two in the strip */
+#define LAST_LOG2  27   /* largest power of two in the strip */
+
+/* One snapshot, with the free bytes summed per power of two */
+typedef struct {
+    int trace, op;
+    double footprint, heap, free, nfree, largest, cached, slab_free;
+    double live, waste;
+    double pow2[32];
+} snap_t;
+
+static void die(char *msg, char *arg)
+{
+    fprintf(stderr, "fragview: %s %s\n", msg, arg);
+    exit(1);
+}
+
+static double extfrag(snap_t *s)
+{
+    return s->free > 0 ? 1 - s->largest / s->free : 0;
+}
+
+/*
+ * parse - Read a snapshot line into s; returns 0 if it is malformed
+ */
+static int parse(char *line, snap_t *s)
+{
+    char *tok;
+    int n, cls;
+    unsigned long count, bytes;
+
+    memset(s, 0, sizeof(*s));
+    if (sscanf(line, "%d %d %lf %lf %lf %lf %lf %lf %lf %lf %lf L%n",
+	       &s->trace, &s->op, &s->footprint, &s->heap, &s->free,
+	       &s->nfree, &s->largest, &s->cached, &s->slab_free,
+	       &s->live, &s->waste, &n) != 11)
+	return 0;
+    for (tok = strtok(line + n, " \n"); tok && strcmp(tok, "W");
+	 tok = strtok(NULL, " \n")) {
+	if (sscanf(tok, "%d:%lu:%lu", &cls, &count, &bytes) != 3 ||
+	    cls < 0 || cls >= 128)
+	    return 0;
+	s->pow2[cls / 4] += bytes;
+    }
+    return 1;
+}
+
+static char shade(double share)
+{
+    static const double cut[] = {0.05, 0.15, 0.30, 0.50, 0.70, 0.85};
+    static const char *chars = ".:-=+*#";
+    int i;
+
+    if (share <= 0)
+	return ' ';
+    for (i = 0; i < 6 && share >= cut[i]; i++)
+	;
+    return chars[i];
+}
+
+static void printrow(snap_t *s)
+{
+    int k;
+
+    printf("%9d%10.1f%10.1f%6.0f%%%10.1f%9.1f  |", s->op,
+	   s->footprint / 1024, s->free / 1024, 100 * extfrag(s),
+	   s->largest / 1024, s->waste / 1024);
+    for (k = FIRST_LOG2; k <= LAST_LOG2; k++)
+	putchar(shade(s->free > 0 ? s->pow2[k] / s->free : 0));
+    printf("|\n");
+}
+
+/*
+ * show - Print the chart and the worst intervals of the n snapshots
+ *     of one trace
+ */
+static void show(snap_t *snaps, int n, int rows, int worst)
+{
+    int i, j, k, top, step = (n + rows - 1) / rows;
+    double *grow;
+
+    printf("Trace %d: %d snapshots, ops 0..%d\n", snaps[0].trace, n,
+	   snaps[n-1].op);
+    printf("%9s%10s%10s%7s%10s%9s  |", "op", "foot KB", "free KB", "frag",
+	   "large KB", "pad KB");
+    for (k = FIRST_LOG2; k <= LAST_LOG2; k++)
+	putchar(k % 4 == 0 ? '0' + (k / 4) % 10 : ' ');
+    printf("| (free bytes by 2^k, k = %d..%d; digits mark k/4)\n",
+	   FIRST_LOG2, LAST_LOG2);
+    for (i = 0; i < n; i += step)
+	printrow(&snaps[i]);
+    if ((n - 1) % step)
+	printrow(&snaps[n-1]);
+
+    /* The intervals whose fragmented bytes grew the most, by selection */
+    if ((grow = malloc(n * sizeof(double))) == NULL)
+	die("out of memory", "");
+    grow[0] = 0;
+    for (i = 1; i < n; i++)
+	grow[i] = (snaps[i].free - snaps[i].largest) -
+	    (snaps[i-1].free - snaps[i-1].largest);
+    printf("Most fragmenting intervals:\n");
+    for (j = 0; j < worst; j++) {
+	for (top = 0, i = 1; i < n; i++)
+	    if (grow[i] > grow[top])
+		top = i;
+	if (grow[top] <= 0)
+	    break;
+	printf("  ops %7d..%-7d  fragmented free bytes %+9.0f, "
+	       "frag %3.0f%% -> %3.0f%%\n", snaps[top-1].op + 1, snaps[top].op,
+	       grow[top], 100 * extfrag(&snaps[top-1]), 100 * extfrag(&snaps[top]));
+	grow[top] = 0;
+    }
+    if (j == 0)
+	printf("  (none)\n");
+    printf("\n");
+    free(grow);
+}
+
+int main(int argc, char **argv)
+{
+    int c, only = -1, rows = ROWS, worst = WORST, n = 0, max = 0;
+    snap_t *snaps = NULL, s;
+    char *line;
+    FILE *fp;
+
+    while ((c = getopt(argc, argv, "t:r:w:")) != EOF) {
+	switch (c) {
+	case 't':
+	    only = atoi(optarg);
+	    break;
+	case 'r':
+	    rows = atoi(optarg);
+	    break;
+	case 'w':
+	    worst = atoi(optarg);
+	    break;
+	default:
+	    optind = argc;
+	}
+    }
+    if (optind != argc - 1 || rows < 1 || worst < 0) {
+	fprintf(stderr, "usage: fragview [-t <trace>] [-r <rows>] [-w <n>] "
+		"<snapfile>\n");
+	exit(1);
+    }
+    if ((fp = fopen(argv[optind], "r")) == NULL)
+	die("could not open", argv[optind]);
+    if ((line = malloc(MAXLINE)) == NULL)
+	die("out of memory", "");
+
+    /* Each trace's snapshots are on consecutive lines */
+    while (fgets(line, MAXLINE, fp) != NULL) {
+	if (line[0] == '#')
+	    continue;
+	if (!parse(line, &s))
+	    die("bad snapshot line in", argv[optind]);
+	if (only >= 0 && s.trace != only)
+	    continue;
+	if (n > 0 && s.trace != snaps[0].trace) {
+	    show(snaps, n, rows, worst);
+	    n = 0;
+	}
+	if (n == max) {
+	    max = max ? 2 * max : 256;
+	    if ((snaps = realloc(snaps, max * sizeof(snap_t))) == NULL)
+		die("out of memory", "");
+	}
+	snaps[n++] = s;
+    }
+    if (n > 0)
+	show(snaps, n, rows, worst);
+    fclose(fp);
+    free(line);
+    free(snaps);
+    return 0;
+}
@@ -1,7 +1,9 @@
 /****************************
  * High-level timing wrappers
  ****************************/
+#define _GNU_SOURCE  /* for sched_getcpu */
 #include <stdio.h>
+#include <sched.h>
 #include "fsecs.h"
 #include "fcyc.h"
 #include "clock.h"
@@ -26,7 +28,7 @@ void init_fsecs(void)
     /* set key parameters for the fcyc package */
     set_fcyc_maxsamples(20); 
     set_fcyc_clear_cache(1);
-    set_fcyc_compensate(1);
+    set_fcyc_compensate(0);  /* tickless kernels: K-best suffices */
     set_fcyc_epsilon(0.01);
     set_fcyc_k(3);
     Mhz = mhz(verbose > 0);
@@ -40,18 +42,70 @@ void init_fsecs(void)
 }
 
 /*
- * fsecs - Return the running time of a function f (in seconds)
+ * pin - Pin the caller to the CPU it is on, saving its old affinity in
+ *     old. Returns 1 if it is pinned.
+ */
+static int pin(cpu_set_t *old)
+{
+    cpu_set_t one;
+    int cpu;
+
+    if ((cpu = sched_getcpu()) < 0 ||
+	sched_getaffinity(0, sizeof(*old), old) != 0)
+	return 0;
+    CPU_ZERO(&one);
+    CPU_SET(cpu, &one);
+    return sched_setaffinity(0, sizeof(one), &one) == 0;
+}
+
+/*
+ * fsecs - Return the running time of a function f (in seconds). The
+ *     caller is pinned to the CPU it is on while f is measured, so
+ *     that a migration cannot spoil a measurement, and is then let go
+ *     again, so that the threads it starts later (mdriver -T) can
+ *     spread out.
  */
 double fsecs(fsecs_test_funct f, void *argp) 
 {
+    cpu_set_t old;
+    int pinned = pin(&old);
+    double secs;
+
 #if USE_FCYC
-    double cycles = fcyc(f, argp);
-    return cycles/(Mhz*1e6);
+    secs = fcyc(f, argp)/(Mhz*1e6);
 #elif USE_ITIMER
-    return ftimer_itimer(f, argp, 10);
+    secs = ftimer_itimer(f, argp, 10);
 #elif USE_GETTOD
-    return ftimer_gettod(f, argp, 10);
+    secs = ftimer_gettod(f, argp, 10);
 #endif 
+
+    if (pinned)
+	sched_setaffinity(0, sizeof(old), &old);
+    return secs;
 }
 
+/*
+ * fsecs_samples - Store the running time of each of n runs of f (in
+ *     seconds) in secs[0..n-1], pinned like fsecs
+ */
+void fsecs_samples(fsecs_test_funct f, void *argp, int n, double *secs)
+{
+    cpu_set_t old;
+    int pinned = pin(&old);
+    int i;
+
+#if USE_FCYC
+    fcyc_samples(f, argp, n, secs);
+    for (i = 0; i < n; i++)
+	secs[i] /= Mhz*1e6;
+#elif USE_ITIMER
+    for (i = 0; i < n; i++)
+	secs[i] = ftimer_itimer(f, argp, 1);
+#elif USE_GETTOD
+    for (i = 0; i < n; i++)
+	secs[i] = ftimer_gettod(f, argp, 1);
+#endif
 
+    if (pinned)
+	sched_setaffinity(0, sizeof(old), &old);
+}
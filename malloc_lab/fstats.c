@@ -0,0 +1,127 @@
+/*
+ * fstats.c - Medians, MADs and bootstrap confidence intervals of timing
+ *            samples (see fstats.h)
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "fstats.h"
+
+/* A fixed seed, so the same samples always give the same intervals */
+static unsigned long long rng_state;
+
+/* rng - xorshift64*; good enough for resampling */
+static unsigned rng(void)
+{
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return (unsigned)((rng_state * 2685821657736338717ULL) >> 32);
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+
+    return (x > y) - (x < y);
+}
+
+/*
+ * median - The median of the n values in x, which it sorts
+ */
+static double median(double *x, int n)
+{
+    qsort(x, n, sizeof(double), cmp_double);
+    return n % 2 ? x[n/2] : (x[n/2 - 1] + x[n/2]) / 2;
+}
+
+/*
+ * resample_median - The median of n values drawn from x[0..n-1] with
+ *     replacement; tmp holds n values
+ */
+static double resample_median(double *x, int n, double *tmp)
+{
+    int i;
+
+    for (i = 0; i < n; i++)
+	tmp[i] = x[rng() % n];
+    return median(tmp, n);
+}
+
+/*
+ * interval - The central FSTATS_CONF interval of the n values in x,
+ *     which it sorts
+ */
+static void interval(double *x, int n, double *lo, double *hi)
+{
+    int k = (int)((1 - FSTATS_CONF) / 2 * n);
+
+    qsort(x, n, sizeof(double), cmp_double);
+    *lo = x[k];
+    *hi = x[n - 1 - k];
+}
+
+void fstats(double *x, int n, fstats_t *s)
+{
+    double *tmp, *boot, med, cut;
+    int i;
+
+    memset(s, 0, sizeof(*s));
+    if ((s->n = n) == 0)
+	return;
+    tmp = malloc(n * sizeof(double));
+    boot = malloc(FSTATS_RESAMPLES * sizeof(double));
+    if (tmp == NULL || boot == NULL)
+	abort();
+
+    memcpy(tmp, x, n * sizeof(double));
+    med = s->median = median(tmp, n);
+    for (i = 0; i < n; i++)
+	tmp[i] = fabs(x[i] - med);
+    s->mad = median(tmp, n);
+
+    cut = FSTATS_OUTLIER * 1.4826 * s->mad;
+    for (i = 0; i < n; i++)
+	if (fabs(x[i] - med) > cut)
+	    s->outliers++;
+
+    rng_state = 88172645463325252ULL;
+    for (i = 0; i < FSTATS_RESAMPLES; i++)
+	boot[i] = resample_median(x, n, tmp);
+    interval(boot, FSTATS_RESAMPLES, &s->lo, &s->hi);
+
+    free(boot);
+    free(tmp);
+}
+
+int fstats_compare(double *a, int na, double *b, int nb,
+		   double *change, double *lo, double *hi)
+{
+    double *tmp, *boot, ma, mb;
+    int i;
+
+    tmp = malloc((na > nb ? na : nb) * sizeof(double));
+    boot = malloc(FSTATS_RESAMPLES * sizeof(double));
+    if (tmp == NULL || boot == NULL)
+	abort();
+
+    memcpy(tmp, a, na * sizeof(double));
+    ma = median(tmp, na);
+    memcpy(tmp, b, nb * sizeof(double));
+    mb = median(tmp, nb);
+    *change = mb / ma - 1;
+
+    /* Resample a and b independently, and take the change each time */
+    rng_state = 88172645463325252ULL;
+    for (i = 0; i < FSTATS_RESAMPLES; i++) {
+	ma = resample_median(a, na, tmp);
+	mb = resample_median(b, nb, tmp);
+	boot[i] = mb / ma - 1;
+    }
+    interval(boot, FSTATS_RESAMPLES, lo, hi);
+
+    free(boot);
+    free(tmp);
+    return *lo > 0 || *hi < 0;
+}
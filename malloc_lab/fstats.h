@@ -0,0 +1,30 @@
+/*
+ * fstats.h - Robust summaries of vectors of timing samples, and a test
+ *            of whether two such vectors differ. Timings on a shared
+ *            machine are skewed by interrupts and by other work, so the
+ *            center is the median, the spread the median absolute
+ *            deviation (MAD), and the confidence intervals come from
+ *            the bootstrap, which assumes nothing about the
+ *            distribution.
+ */
+#define FSTATS_RESAMPLES 2000  /* bootstrap resamples */
+#define FSTATS_CONF      0.95  /* confidence level of the intervals */
+#define FSTATS_OUTLIER   3.0   /* outliers lie this many scaled MADs out */
+
+typedef struct {
+    int n;            /* samples */
+    double median;    /* their median */
+    double mad;       /* median absolute deviation from the median */
+    double lo, hi;    /* confidence interval of the median */
+    int outliers;     /* samples more than FSTATS_OUTLIER*1.4826*mad
+			 from the median */
+} fstats_t;
+
+/* Summarize the n samples x[] in s; x is left alone */
+void fstats(double *x, int n, fstats_t *s);
+
+/* The relative change median(b)/median(a) - 1 of the samples b[] over
+   the samples a[], with its confidence interval in lo..hi. Returns 1
+   if the interval excludes 0, that is, if the change is significant */
+int fstats_compare(double *a, int na, double *b, int nb,
+		   double *change, double *lo, double *hi);
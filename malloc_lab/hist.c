@@ -0,0 +1,65 @@
+/*
+ * hist.c - Log-bucketed latency histograms (see hist.h)
+ */
+#include "hist.h"
+
+/*
+ * hist_bucket - The bucket counting value v: v itself below HIST_SUB,
+ *     else HIST_SUB buckets for each power of two, indexed by the
+ *     HIST_SUB_LOG2 bits below the leading one.
+ */
+static int hist_bucket(unsigned long v)
+{
+    int f;
+
+    if (v < HIST_SUB)
+	return (int)v;
+    f = 63 - __builtin_clzl(v);
+    return (f - HIST_SUB_LOG2 + 1) * HIST_SUB + 
+	(int)((v >> (f - HIST_SUB_LOG2)) ^ HIST_SUB);
+}
+
+unsigned long hist_bucket_lo(int i)
+{
+    int f;
+
+    if (i < HIST_SUB)
+	return i;
+    f = i / HIST_SUB + HIST_SUB_LOG2 - 1;
+    return (unsigned long)(HIST_SUB + i % HIST_SUB) << (f - HIST_SUB_LOG2);
+}
+
+unsigned long hist_bucket_hi(int i)
+{
+    int f;
+
+    if (i < HIST_SUB)
+	return i;
+    f = i / HIST_SUB + HIST_SUB_LOG2 - 1;
+    return hist_bucket_lo(i) + (1UL << (f - HIST_SUB_LOG2)) - 1;
+}
+
+void hist_add(hist_t *h, unsigned long v)
+{
+    h->count[hist_bucket(v)]++;
+    h->n++;
+    if (v > h->max)
+	h->max = v;
+}
+
+unsigned long hist_quantile(hist_t *h, double q)
+{
+    unsigned long rank, seen = 0, hi;
+    int i;
+
+    if (h->n == 0)
+	return 0;
+    rank = (unsigned long)(q * h->n);
+    if (rank >= h->n)
+	rank = h->n - 1;
+    for (i = 0; i < HIST_BUCKETS; i++)
+	if ((seen += h->count[i]) > rank)
+	    break;
+    hi = hist_bucket_hi(i);
+    return hi < h->max ? hi : h->max;
+}
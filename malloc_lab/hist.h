@@ -0,0 +1,27 @@
+/*
+ * hist.h - Log-bucketed histograms of latencies, in the manner of HDR
+ *          histograms: each power of two is cut into HIST_SUB equal
+ *          buckets, so any recorded value is known to within 1/HIST_SUB
+ *          of itself (6%), whatever its magnitude, in a fixed amount of
+ *          space. Values below HIST_SUB are counted exactly.
+ */
+#define HIST_SUB_LOG2  4
+#define HIST_SUB       (1 << HIST_SUB_LOG2)
+#define HIST_BUCKETS   ((64 - HIST_SUB_LOG2 + 1) * HIST_SUB)
+
+typedef struct {
+    unsigned long n;                      /* values recorded */
+    unsigned long max;                    /* largest value recorded */
+    unsigned long count[HIST_BUCKETS];    /* values in each bucket */
+} hist_t;
+
+/* Record value v */
+void hist_add(hist_t *h, unsigned long v);
+
+/* The value below which a fraction q of the values lie, as the top
+   of its bucket (but never above the largest value); 0 if empty */
+unsigned long hist_quantile(hist_t *h, double q);
+
+/* The smallest and largest values that bucket i counts */
+unsigned long hist_bucket_lo(int i);
+unsigned long hist_bucket_hi(int i);
@@ -7,19 +7,33 @@
  * Copyright (c) 2002, R. Bryant and D. O'Hallaron, All rights reserved.
  * May not be used, modified, or copied without permission.
  */
+#define _GNU_SOURCE  /* for sched_setaffinity */
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
+#include <sched.h>
 #include <errno.h>
 #include <string.h>
 #include <assert.h>
 #include <float.h>
+#include <limits.h>
 #include <time.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <fcntl.h>
 
 #include "mm.h"
 #include "memlib.h"
 #include "fsecs.h"
+#include "clock.h"
 #include "config.h"
+#include "trace.h"
+#include "hist.h"
+#include "fperf.h"
+#include "fstats.h"
 
 /**********************
  * Constants and macros
@@ -29,28 +43,34 @@
 #define MAXLINE     1024 /* max string size */
 #define HDRLINES       4 /* number of header lines in a trace file */
 #define LINENUM(i) (i+5) /* cnvt trace request nums to linenums (origin 1) */
+#define MAXTHREADS    64 /* max replay threads for -T */
+#define MT_RUNS        3 /* replays averaged per thread count in -T mode */
+#define MAXBATCH    4096 /* max ops grouped into one batch for -b */
+#define MAXJOBS      256 /* max worker processes for -j */
+#define PERF_RUNS     10 /* replays whose events are counted for -P */
+#define MAXRUNS      200 /* max timed replays per trace for -S */
+#define MAXVARIANTS   16 /* max compile-time variants for -K */
+#define DEFAULT_RUNS  30 /* timed replays per trace for -O without -S */
+#define SNAPS        200 /* heap snapshots per trace for -F without -I */
+#define RANGE_CHUNK 4096 /* range records malloc'd at a time */
 
 /* Returns true if p is ALIGNMENT-byte aligned */
-#define IS_ALIGNED(p)  ((((unsigned int)(p)) % ALIGNMENT) == 0)
+#define IS_ALIGNED(p)  ((((size_t)(p)) % ALIGNMENT) == 0)
 
 /****************************** 
  * The key compound data types 
  *****************************/
 
-/* Records the extent of each block's payload */
+/* Records the extent of each block's payload, as a node of a treap
+   (a binary search tree on lo that is a heap on prio) */
 typedef struct range_t {
     char *lo;              /* low payload address */
     char *hi;              /* high payload address */
-    struct range_t *next;  /* next list element */
+    unsigned int prio;     /* random priority, not below the children's */
+    struct range_t *left;  /* payloads below lo (next free record in pool) */
+    struct range_t *right; /* payloads above lo */
 } range_t;
 
-/* Characterizes a single trace operation (allocator request) */
-typedef struct {
-    enum {ALLOC, FREE, REALLOC} type; /* type of request */
-    int index;                        /* index for free() to use later */
-    int size;                         /* byte size of alloc/realloc request */
-} traceop_t;
-
 /* Holds the information for one trace file*/
 typedef struct {
     int sugg_heapsize;   /* suggested heap size (unused) */
@@ -58,6 +78,8 @@ typedef struct {
     int num_ops;         /* number of distinct requests */
     int weight;          /* weight for this trace (unused) */
     traceop_t *ops;      /* array of requests */
+    void *map;           /* mapping of a binary trace file ops point into... */
+    size_t map_len;      /* ...and its length, or NULL and 0 for a .rep file */
     char **blocks;       /* array of ptrs returned by malloc/realloc... */
     size_t *block_sizes; /* ... and a corresponding array of payload sizes */
 } trace_t;
@@ -81,15 +103,48 @@ typedef struct {
 
     /* defined only for the student malloc package */
     double util;     /* space utilization for this trace (always 0 for libc) */
+    double avg_heap; /* heap size in bytes, averaged over the ops */
+    double peak_heap;/* largest heap size in bytes */
+    double events[FPERF_EVENTS]; /* hardware events per replay for -P,
+				    -1 for events that were not counted */
+    double run_secs[MAXRUNS]; /* secs of each timed replay for -S */
 
     /* Note: secs and util are only defined if valid is true */
 } stats_t; 
 
+/* Latencies of the ops of one trace in cycles, for -L */
+typedef struct {
+    hist_t op[3];    /* indexed by ALLOC, FREE and REALLOC */
+} lat_t;
+
+/* The results for one trace that a -j worker hands back to mdriver */
+typedef struct {
+    int errors;                   /* errors found while evaluating it */
+    stats_t stats;                /* its stats */
+    double mt_secs[MAXTHREADS];   /* secs for each -T thread count */
+    lat_t lat;                    /* its latencies, for -L */
+} job_result_t;
+
+/* Holds the params of one replay thread in the multithreaded (-T) mode */
+typedef struct {
+    trace_t *trace;   /* trace shared (read-only) by all threads */
+    char **blocks;    /* this thread's own array of ptrs returned by malloc */
+    int failed;       /* set if the allocator ran out of memory */
+} mt_thread_t;
+
 /********************
  * Global variables
  *******************/
 int verbose = 0;        /* global flag for verbose output */
 static int errors = 0;  /* number of errs found when running student malloc */
+static int batch = 0;   /* max ops per mm batch call for -b (0 = off) */
+static int perf_events = 0; /* count hardware events for -P? */
+static int runs = 0;    /* timed replays per trace for -S (0 = off) */
+static int snap_fd = -1;      /* heap snapshot file for -F (-1 = off) */
+static int snap_interval = 0; /* ops between snapshots for -I (0 = auto) */
+static void *batch_ptrs[MAXBATCH]; /* the blocks of the current batch */
+static range_t *range_pool;        /* free range records */
+static unsigned int range_seed = 1;/* priority generator for range records */
 char msg[MAXLINE];      /* for whenever we need to compose an error message */
 
 /* Directory where default tracefiles are found */
@@ -100,12 +155,18 @@ static char *default_tracefiles[] = {
     DEFAULT_TRACEFILES, NULL
 };
 
+/* Names of the trace op types, for the latency reports */
+static char *op_names[] = {"malloc", "free", "realloc"};
+
+/* Names of mm.c's placement policies, for -p and -A */
+static char *policy_names[] = {"lifo", "address", "bestfit", "nextfit"};
+
 
 /********************* 
  * Function prototypes 
  *********************/
 
-/* these functions manipulate range lists */
+/* these functions manipulate range trees */
 static int add_range(range_t **ranges, char *lo, int size, 
 		     int tracenum, int opnum);
 static void remove_range(range_t **ranges, char *lo);
@@ -113,6 +174,7 @@ static void clear_ranges(range_t **ranges);
 
 /* These functions read, allocate, and free storage for traces */
 static trace_t *read_trace(char *tracedir, char *filename);
+static void map_bintrace(trace_t *trace, FILE *tracefile, char *path);
 static void free_trace(trace_t *trace);
 
 /* Routines for evaluating the correctness and speed of libc malloc */
@@ -122,12 +184,38 @@ static void eval_libc_speed(void *ptr);
 /* Routines for evaluating correctnes, space utilization, and speed 
    of the student's malloc package in mm.c */
 static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges);
-static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges);
+static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges,
+			   double *avg_heap, double *peak_heap);
 static void eval_mm_speed(void *ptr);
+static double eval_mm_mt(trace_t *trace, int nthreads);
+static void eval_mm_snapshots(trace_t *trace, int tracenum);
+static void eval_mm_matrix(char **tracefiles, int n, range_t **ranges,
+			   char **names, int ncols, void (*setup)(int, int),
+			   int k);
+static void select_policy(int p, int k);
+static void select_variant(int v, int k);
+static void *mt_replay(void *arg);
+static int batch_len(trace_t *trace, int i);
+static void eval_mm_latency(trace_t *trace, lat_t *lat);
+static void eval_mm_trace(char *tracefile, int tracenum, range_t **ranges,
+			  stats_t *stats, int nlevels, int *threads,
+			  double *mt_secs, int stride, lat_t *lat);
+static void eval_mm_parallel(int njobs, char **tracefiles, int n,
+			     range_t **ranges, stats_t *stats, int nlevels,
+			     int *threads, double *mt_secs, lat_t *lat);
 
 /* Various helper routines */
 static void printresults(int n, stats_t *stats);
+static void printmtresults(int n, stats_t *stats, int nlevels, 
+			   int *threads, double *mt_secs);
+static void printheapresults(int n, stats_t *stats);
+static void printlatresults(int n, stats_t *stats, lat_t *lat);
+static void printperfresults(int n, stats_t *stats);
+static void write_histograms(char *path, int n, stats_t *stats, lat_t *lat);
+static void printrunresults(int n, stats_t *stats);
+static void write_samples(char *path, int n, stats_t *stats);
 static void usage(void);
+static size_t parse_bytes(char *s);
 static void unix_error(char *msg);
 static void malloc_error(int tracenum, int opnum, char *msg);
 static void app_error(char *msg);
@@ -137,7 +225,7 @@ static void app_error(char *msg);
  **************/
 int main(int argc, char **argv)
 {
-    int i;
+    int i, j;
     char c;
     char **tracefiles = NULL;  /* null-terminated array of trace file names */
     int num_tracefiles = 0;    /* the number of traces in that array */
@@ -146,6 +234,26 @@ int main(int argc, char **argv)
     stats_t *libc_stats = NULL;/* libc stats for each trace */
     stats_t *mm_stats = NULL;  /* mm (i.e. student) stats for each trace */
     speed_t speed_params;      /* input parameters to the xx_speed routines */ 
+    int mt_threads = 0;        /* max replay threads for -T (0 = off) */
+    int mt_levels = 0;         /* number of thread counts measured */
+    int mt_counts[MAXTHREADS]; /* the thread counts: 1, 2, 4, ..., mt_threads */
+    double *mt_secs = NULL;    /* secs per trace for each thread count */
+    int jobs = 1;              /* worker processes for -j */
+    lat_t *mm_lat = NULL;      /* per-op latencies of each trace for -L */
+    int latency = 0;           /* If set, measure op latencies (-L, -H) */
+    char *histfile = NULL;     /* CSV file for the latency histograms (-H) */
+    char *samplefile = NULL;   /* CSV file for the timed replays (-O) */
+    char *snapfile = NULL;     /* file for the heap snapshots (-F) */
+    size_t max_heap;           /* heap limit for -M */
+    int policy = -1;           /* placement policy for -p (-1 = default) */
+    int policy_k = 0;          /* ...and its best-fit candidates */
+    size_t len = 0;            /* length of the -p policy name... */
+    char *end;                 /* ...and the end of its k */
+    long k;
+    int all_policies = 0;      /* If set, compare every policy (-A) */
+    int all_variants = 0;      /* If set, compare every variant (-K) */
+    char *variant_names[MAXVARIANTS]; /* ...and their names */
+    int num_variants = 0;
 
     int team_check = 1;  /* If set, check team structure (reset by -a) */
     int run_libc = 0;    /* If set, run libc malloc (set by -l) */
@@ -158,7 +266,7 @@ int main(int argc, char **argv)
     /* 
      * Read and interpret the command line arguments 
      */
-    while ((c = getopt(argc, argv, "f:t:hvVgal")) != EOF) {
+    while ((c = getopt(argc, argv, "f:t:T:b:j:H:S:O:F:I:M:p:AKLPhvVgal")) != EOF) {
         switch (c) {
 	case 'g': /* Generate summary info for the autograder */
 	    autograder = 1;
@@ -178,6 +286,90 @@ int main(int argc, char **argv)
 	    if (tracedir[strlen(tracedir)-1] != '/') 
 		strcat(tracedir, "/"); /* path always ends with "/" */
 	    break;
+	case 'T': /* Also replay each trace on up to n threads at once */
+	    mt_threads = atoi(optarg);
+	    if (mt_threads < 1 || mt_threads > MAXTHREADS) {
+		usage();
+		exit(1);
+	    }
+	    break;
+	case 'b': /* Group runs of allocs/frees into mm batch calls */
+	    batch = atoi(optarg);
+	    if (batch < 1 || batch > MAXBATCH) {
+		usage();
+		exit(1);
+	    }
+	    break;
+	case 'j': /* Evaluate the mm traces on n worker processes */
+	    jobs = atoi(optarg);
+	    if (jobs < 1 || jobs > MAXJOBS) {
+		usage();
+		exit(1);
+	    }
+	    break;
+	case 'L': /* Report per-op latency percentiles */
+	    latency = 1;
+	    break;
+	case 'P': /* Count hardware events with perf_event_open */
+	    perf_events = 1;
+	    break;
+	case 'H': /* ...and write the latency histograms to a CSV file */
+	    latency = 1;
+	    histfile = optarg;
+	    break;
+	case 'S': /* Time n replays of each trace and report their spread */
+	    runs = atoi(optarg);
+	    if (runs < 1 || runs > MAXRUNS) {
+		usage();
+		exit(1);
+	    }
+	    break;
+	case 'O': /* ...and write the replay times to a CSV file */
+	    samplefile = optarg;
+	    break;
+	case 'F': /* Write heap snapshots taken during replay to a file */
+	    snapfile = optarg;
+	    break;
+	case 'M': /* Let the heap grow to this many bytes (K, M, G suffixes) */
+	    if ((max_heap = parse_bytes(optarg)) == 0) {
+		usage();
+		exit(1);
+	    }
+	    mem_set_max_heap(max_heap);
+	    break;
+	case 'p': /* Placement policy of mm.c, with bestfit:k for k */
+	    for (policy = 0; policy < MM_POLICIES; policy++) {
+		len = strlen(policy_names[policy]);
+		if (!strncmp(optarg, policy_names[policy], len) &&
+		    (optarg[len] == '\0' || optarg[len] == ':'))
+		    break;
+	    }
+	    if (policy == MM_POLICIES) {
+		usage();
+		exit(1);
+	    }
+	    if (optarg[len] == ':') {
+		k = strtol(optarg + len + 1, &end, 10);
+		if (end == optarg + len + 1 || *end || k < 1 || k > INT_MAX) {
+		    usage();
+		    exit(1);
+		}
+		policy_k = (int)k;
+	    }
+	    break;
+	case 'A': /* Also evaluate every placement policy of mm.c */
+	    all_policies = 1;
+	    break;
+	case 'K': /* Also evaluate every compile-time variant of mm.c */
+	    all_variants = 1;
+	    break;
+	case 'I': /* ...every n ops */
+	    snap_interval = atoi(optarg);
+	    if (snap_interval < 1) {
+		usage();
+		exit(1);
+	    }
+	    break;
         case 'a': /* Don't check team structure */
             team_check = 0;
             break;
@@ -198,6 +390,38 @@ int main(int argc, char **argv)
             exit(1);
         }
     }
+    if (samplefile && !runs)
+	runs = DEFAULT_RUNS;
+    if ((policy >= 0 || all_policies) && mm_set_policy == NULL)
+	app_error("This mm package has no placement policies (-p, -A)");
+    if (policy >= 0)
+	mm_set_policy(policy, policy_k);
+    if (all_variants) {
+	if (mm_set_variant == NULL)
+	    app_error("This mm package has no variants (-K); try mdriver-variants");
+	while (num_variants < MAXVARIANTS &&
+	       (variant_names[num_variants] = mm_variant_name(num_variants)) != NULL)
+	    num_variants++;
+    }
+    if (snapfile) {
+	if (mm_snapshot == NULL)
+	    app_error("This mm package does not support heap snapshots (-F)");
+	/* Each trace appends its snapshots with one write, so that -j
+	   workers do not interleave them */
+	if ((snap_fd = open(snapfile, O_WRONLY|O_CREAT|O_TRUNC|O_APPEND, 
+			    0644)) < 0) {
+	    sprintf(msg, "Could not open %s", snapfile);
+	    unix_error(msg);
+	}
+	sprintf(msg, "# mdriver heap snapshots, one per line: trace op "
+		"footprint heap free nfree largest cached slab_free live waste\n"
+		"#   L class:blocks:bytes ... (free blocks by list; class i "
+		"from 2^(i/4) up)\n"
+		"#   W k:bytes ... (padding of blocks of 2^k to 2^(k+1)-1 "
+		"requested bytes)\n");
+	if (write(snap_fd, msg, strlen(msg)) < 0)
+	    unix_error("write error on the snapshot file");
+    }
 	
     /* 
      * Check and print team info 
@@ -284,34 +508,86 @@ int main(int argc, char **argv)
     if (mm_stats == NULL)
 	unix_error("mm_stats calloc in main failed");
     
+    /* Thread counts for -T: powers of two up to and including mt_threads */
+    if (mt_threads) {
+	for (j = 1; j < mt_threads; j *= 2)
+	    mt_counts[mt_levels++] = j;
+	mt_counts[mt_levels++] = mt_threads;
+	if ((mt_secs = (double *)calloc(mt_levels * num_tracefiles, 
+					sizeof(double))) == NULL)
+	    unix_error("mt_secs calloc in main failed");
+    }
+
+    if (latency && (mm_lat = (lat_t *)calloc(num_tracefiles, 
+					     sizeof(lat_t))) == NULL)
+	unix_error("mm_lat calloc in main failed");
+
     /* Initialize the simulated memory system in memlib.c */
     mem_init(); 
 
     /* Evaluate student's mm malloc package using the K-best scheme */
-    for (i=0; i < num_tracefiles; i++) {
-	trace = read_trace(tracedir, tracefiles[i]);
-	mm_stats[i].ops = trace->num_ops;
-	if (verbose > 1)
-	    printf("Checking mm_malloc for correctness, ");
-	mm_stats[i].valid = eval_mm_valid(trace, i, &ranges);
-	if (mm_stats[i].valid) {
-	    if (verbose > 1)
-		printf("efficiency, ");
-	    mm_stats[i].util = eval_mm_util(trace, i, &ranges);
-	    speed_params.trace = trace;
-	    speed_params.ranges = ranges;
-	    if (verbose > 1)
-		printf("and performance.\n");
-	    mm_stats[i].secs = fsecs(eval_mm_speed, &speed_params);
-	}
-	free_trace(trace);
-    }
+    if (jobs > 1)
+	eval_mm_parallel(jobs, tracefiles, num_tracefiles, &ranges, mm_stats,
+			 mt_levels, mt_counts, mt_secs, mm_lat);
+    else
+	for (i=0; i < num_tracefiles; i++)
+	    eval_mm_trace(tracefiles[i], i, &ranges, &mm_stats[i],
+			  mt_levels, mt_counts, mt_secs + i, num_tracefiles,
+			  mm_lat ? &mm_lat[i] : NULL);
 
     /* Display the mm results in a compact table */
     if (verbose) {
-	printf("\nResults for mm malloc:\n");
+	if (batch)
+	    printf("\nResults for mm malloc (batches of up to %d ops):\n", batch);
+	else
+	    printf("\nResults for mm malloc:\n");
 	printresults(num_tracefiles, mm_stats);
 	printf("\n");
+	printf("Heap footprint for mm malloc (KB):\n");
+	printheapresults(num_tracefiles, mm_stats);
+	printf("\n");
+    }
+    if (mt_threads) {
+	printf("Multithreaded throughput for mm malloc (Kops):\n");
+	printmtresults(num_tracefiles, mm_stats, mt_levels, mt_counts, mt_secs);
+	printf("\n");
+    }
+    if (perf_events) {
+	printf("Hardware events for mm malloc (per op):\n");
+	printperfresults(num_tracefiles, mm_stats);
+	printf("\n");
+    }
+    if (snap_fd >= 0 && close(snap_fd) < 0)
+	unix_error("close error on the snapshot file");
+    if (all_policies) {
+	printf("Placement policies of mm malloc (util, Kops; blocks of "
+	       "32 KB and up are best fit under all):\n");
+	eval_mm_matrix(tracefiles, num_tracefiles, &ranges, policy_names,
+		       MM_POLICIES, select_policy, policy_k);
+	mm_set_policy(policy >= 0 ? policy : MM_LIFO, policy_k);
+	printf("\n");
+    }
+    if (all_variants) {
+	printf("Compile-time variants of mm malloc (util, Kops):\n");
+	eval_mm_matrix(tracefiles, num_tracefiles, &ranges, variant_names,
+		       num_variants, select_variant, 0);
+	mm_set_variant(0);
+	printf("\n");
+    }
+    if (runs) {
+	printf("Throughput of %d replays for mm malloc (Kops, %.0f%% CI of median):\n",
+	       runs, FSTATS_CONF * 100);
+	printrunresults(num_tracefiles, mm_stats);
+	printf("\n");
+	if (samplefile)
+	    write_samples(samplefile, num_tracefiles, mm_stats);
+    }
+    if (latency) {
+	printf("Latency for mm malloc (cycles):\n");
+	printlatresults(num_tracefiles, mm_stats, mm_lat);
+	printf("\n");
+	if (histfile)
+	    write_histograms(histfile, num_tracefiles, mm_stats, mm_lat);
     }
 
     /* 
@@ -372,17 +648,88 @@ int main(int argc, char **argv)
  * range list to detect any overlapping allocated blocks.
  ****************************************************************/
 
+/*
+ * range_alloc - Get a range record from the pool, refilling the pool
+ *     RANGE_CHUNK records at a time
+ */
+static range_t *range_alloc(void)
+{
+    range_t *p;
+    int i;
+
+    if (range_pool == NULL) {
+	if ((p = (range_t *)malloc(RANGE_CHUNK * sizeof(range_t))) == NULL)
+	    unix_error("malloc error in range_alloc");
+	for (i = 0; i < RANGE_CHUNK; i++) {
+	    p[i].left = range_pool;
+	    range_pool = &p[i];
+	}
+    }
+    p = range_pool;
+    range_pool = p->left;
+    return p;
+}
+
+/*
+ * range_insert - Insert record p into the treap rooted at t and return
+ *     the new root, rotating p up while it outranks its parent
+ */
+static range_t *range_insert(range_t *t, range_t *p)
+{
+    range_t *c;
+
+    if (t == NULL)
+	return p;
+    if (p->lo < t->lo) {
+	c = t->left = range_insert(t->left, p);
+	if (c->prio > t->prio) {         /* rotate right */
+	    t->left = c->right;
+	    c->right = t;
+	    return c;
+	}
+    }
+    else {
+	c = t->right = range_insert(t->right, p);
+	if (c->prio > t->prio) {         /* rotate left */
+	    t->right = c->left;
+	    c->left = t;
+	    return c;
+	}
+    }
+    return t;
+}
+
+/*
+ * range_join - Join treaps a and b, all of whose records lie below
+ *     those of b, and return the new root
+ */
+static range_t *range_join(range_t *a, range_t *b)
+{
+    if (a == NULL)
+	return b;
+    if (b == NULL)
+	return a;
+    if (a->prio > b->prio) {
+	a->right = range_join(a->right, b);
+	return a;
+    }
+    b->left = range_join(a, b->left);
+    return b;
+}
+
 /*
  * add_range - As directed by request opnum in trace tracenum,
  *     we've just called the student's mm_malloc to allocate a block of 
  *     size bytes at addr lo. After checking the block for correctness,
- *     we create a range struct for this block and add it to the range list. 
+ *     we create a range struct for this block and add it to the range
+ *     tree. Live payloads never overlap, so only the payloads just
+ *     below and just above lo in address order need to be checked.
  */
 static int add_range(range_t **ranges, char *lo, int size, 
 		     int tracenum, int opnum)
 {
     char *hi = lo + size - 1;
-    range_t *p;
+    range_t *p, *below = NULL, *above = NULL;
     char msg[MAXLINE];
 
     assert(size > 0);
@@ -395,9 +742,11 @@ static int add_range(range_t **ranges, char *lo, int size,
         return 0;
     }
 
-    /* The payload must lie within the extent of the heap */
-    if ((lo < (char *)mem_heap_lo()) || (lo > (char *)mem_heap_hi()) || 
-	(hi < (char *)mem_heap_lo()) || (hi > (char *)mem_heap_hi())) {
+    /* The payload must lie within the extent of the heap, or else
+       within one of the package's mem_mmap mappings */
+    if (((lo < (char *)mem_heap_lo()) || (lo > (char *)mem_heap_hi()) || 
+	 (hi < (char *)mem_heap_lo()) || (hi > (char *)mem_heap_hi())) &&
+	!mem_is_mapped(lo, hi)) {
 	sprintf(msg, "Payload (%p:%p) lies outside heap (%p:%p)",
 		lo, hi, mem_heap_lo(), mem_heap_hi());
 	malloc_error(tracenum, opnum, msg);
@@ -405,26 +754,33 @@ static int add_range(range_t **ranges, char *lo, int size,
     }
 
     /* The payload must not overlap any other payloads */
-    for (p = *ranges;  p != NULL;  p = p->next) {
-        if ((lo >= p->lo && lo <= p-> hi) ||
-            (hi >= p->lo && hi <= p->hi)) {
-	    sprintf(msg, "Payload (%p:%p) overlaps another payload (%p:%p)\n",
-		    lo, hi, p->lo, p->hi);
-	    malloc_error(tracenum, opnum, msg);
-	    return 0;
-        }
+    for (p = *ranges;  p != NULL;  p = (lo < p->lo) ? p->left : p->right) {
+	if (lo < p->lo)
+	    above = p;
+	else
+	    below = p;
+    }
+    if (below != NULL && below->hi >= lo)
+	p = below;
+    else if (above != NULL && above->lo <= hi)
+	p = above;
+    if (p != NULL) {
+	sprintf(msg, "Payload (%p:%p) overlaps another payload (%p:%p)\n",
+		lo, hi, p->lo, p->hi);
+	malloc_error(tracenum, opnum, msg);
+	return 0;
     }
 
     /* 
      * Everything looks OK, so remember the extent of this block 
-     * by creating a range struct and adding it the range list.
+     * by creating a range struct and adding it the range tree.
      */
-    if ((p = (range_t *)malloc(sizeof(range_t))) == NULL)
-	unix_error("malloc error in add_range");
-    p->next = *ranges;
+    p = range_alloc();
     p->lo = lo;
     p->hi = hi;
-    *ranges = p;
+    p->prio = range_seed = range_seed * 1103515245 + 12345;
+    p->left = p->right = NULL;
+    *ranges = range_insert(*ranges, p);
     return 1;
 }
 
@@ -433,18 +789,14 @@ static int add_range(range_t **ranges, char *lo, int size,
  */
 static void remove_range(range_t **ranges, char *lo)
 {
-    range_t *p;
-    range_t **prevpp = ranges;
-    int size;
-
-    for (p = *ranges;  p != NULL; p = p->next) {
-        if (p->lo == lo) {
-	    *prevpp = p->next;
-            size = p->hi - p->lo + 1;
-            free(p);
-            break;
-        }
-        prevpp = &(p->next);
+    range_t *p, **pp = ranges;
+
+    while ((p = *pp) != NULL && p->lo != lo)
+	pp = (lo < p->lo) ? &p->left : &p->right;
+    if (p != NULL) {
+	*pp = range_join(p->left, p->right);
+	p->left = range_pool;
+	range_pool = p;
     }
 }
 
@@ -453,13 +805,14 @@ static void remove_range(range_t **ranges, char *lo)
  */
 static void clear_ranges(range_t **ranges)
 {
-    range_t *p;
-    range_t *pnext;
-
-    for (p = *ranges;  p != NULL;  p = pnext) {
-        pnext = p->next;
-        free(p);
-    }
+    range_t *p = *ranges;
+
+    if (p == NULL)
+	return;
+    clear_ranges(&p->left);
+    clear_ranges(&p->right);
+    p->left = range_pool;
+    range_pool = p;
     *ranges = NULL;
 }
 
@@ -469,7 +822,9 @@ static void clear_ranges(range_t **ranges)
  *********************************************/
 
 /*
- * read_trace - read a trace file and store it in memory
+ * read_trace - read a trace file and store it in memory. Binary traces
+ *     (see trace.h) are recognized by their magic number and mapped
+ *     rather than read.
  */
 static trace_t *read_trace(char *tracedir, char *filename)
 {
@@ -495,6 +850,15 @@ static trace_t *read_trace(char *tracedir, char *filename)
 	sprintf(msg, "Could not open %s in read_trace", path);
 	unix_error(msg);
     }
+    if (fread(type, 1, 4, tracefile) == 4 && 
+	!memcmp(type, BINTRACE_MAGIC, 4)) {
+	map_bintrace(trace, tracefile, path);
+	fclose(tracefile);
+	return trace;
+    }
+    rewind(tracefile);
+    trace->map = NULL;
+    trace->map_len = 0;
     fscanf(tracefile, "%d", &(trace->sugg_heapsize)); /* not used */
     fscanf(tracefile, "%d", &(trace->num_ids));     
     fscanf(tracefile, "%d", &(trace->num_ops));     
@@ -538,6 +902,7 @@ static trace_t *read_trace(char *tracedir, char *filename)
 	    fscanf(tracefile, "%ud", &index);
 	    trace->ops[op_index].type = FREE;
 	    trace->ops[op_index].index = index;
+	    trace->ops[op_index].size = 0;
 	    break;
 	default:
 	    printf("Bogus type character (%c) in tracefile %s\n", 
@@ -554,13 +919,70 @@ static trace_t *read_trace(char *tracedir, char *filename)
     return trace;
 }
 
+/*
+ * map_bintrace - Map the binary trace file open as tracefile into
+ *     trace, with trace->ops pointing at the records in the mapping.
+ *     The records are checked once here, since the replay trusts them.
+ */
+static void map_bintrace(trace_t *trace, FILE *tracefile, char *path)
+{
+    bintrace_hdr_t *hdr;
+    struct stat st;
+    int i;
+
+    if (fstat(fileno(tracefile), &st) < 0)
+	unix_error("fstat failed in map_bintrace");
+    if (st.st_size < sizeof(bintrace_hdr_t)) {
+	printf("Truncated binary tracefile %s\n", path);
+	exit(1);
+    }
+    trace->map_len = st.st_size;
+    trace->map = mmap(NULL, trace->map_len, PROT_READ, MAP_PRIVATE, 
+		      fileno(tracefile), 0);
+    if (trace->map == MAP_FAILED)
+	unix_error("mmap failed in map_bintrace");
+
+    hdr = (bintrace_hdr_t *)trace->map;
+    if (hdr->version != BINTRACE_VERSION || hdr->num_ops < 0 || 
+	hdr->num_ids < 0 || trace->map_len != sizeof(bintrace_hdr_t) + 
+	(size_t)hdr->num_ops * sizeof(traceop_t)) {
+	printf("Bad header in binary tracefile %s\n", path);
+	exit(1);
+    }
+    trace->sugg_heapsize = hdr->sugg_heapsize;
+    trace->num_ids = hdr->num_ids;
+    trace->num_ops = hdr->num_ops;
+    trace->weight = hdr->weight;
+    trace->ops = (traceop_t *)(hdr + 1);
+    madvise(trace->map, trace->map_len, MADV_SEQUENTIAL);
+
+    for (i = 0; i < trace->num_ops; i++)
+	if ((unsigned)trace->ops[i].type > REALLOC ||
+	    (unsigned)trace->ops[i].index >= (unsigned)trace->num_ids ||
+	    trace->ops[i].size < 0) {
+	    printf("Bad op %d in binary tracefile %s\n", i, path);
+	    exit(1);
+	}
+
+    if ((trace->blocks = 
+	 (char **)malloc(trace->num_ids * sizeof(char *))) == NULL)
+	unix_error("malloc 3 failed in map_bintrace");
+    if ((trace->block_sizes = 
+	 (size_t *)malloc(trace->num_ids * sizeof(size_t))) == NULL)
+	unix_error("malloc 4 failed in map_bintrace");
+}
+
 /*
  * free_trace - Free the trace record and the three arrays it points
- *              to, all of which were allocated in read_trace().
+ *              to, all of which were allocated in read_trace(), or
+ *              unmap the ops of a binary trace.
  */
 void free_trace(trace_t *trace)
 {
-    free(trace->ops);         /* free the three arrays... */
+    if (trace->map)           /* free the three arrays... */
+	munmap(trace->map, trace->map_len);
+    else
+	free(trace->ops);         
     free(trace->blocks);      
     free(trace->block_sizes);
     free(trace);              /* and the trace record itself... */
@@ -576,7 +998,7 @@ void free_trace(trace_t *trace)
  */
 static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges) 
 {
-    int i, j;
+    int i, j, n;
     int index;
     int size;
     int oldsize;
@@ -584,7 +1006,7 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
     char *oldp;
     char *p;
     
-    /* Reset the heap and free any records in the range list */
+    /* Reset the heap and free any records in the range tree */
     mem_reset_brk();
     clear_ranges(ranges);
 
@@ -599,6 +1021,35 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
 	index = trace->ops[i].index;
 	size = trace->ops[i].size;
 
+	/* In -b mode, a run of allocs or frees is one batch call */
+	if ((n = batch_len(trace, i)) > 1) {
+	    if (trace->ops[i].type == ALLOC) {
+		if (mm_malloc_batch(size, n, batch_ptrs) < n) {
+		    malloc_error(tracenum, i, "mm_malloc_batch failed.");
+		    return 0;
+		}
+		for (j = 0; j < n; j++) {
+		    p = batch_ptrs[j];
+		    index = trace->ops[i+j].index;
+		    if (add_range(ranges, p, size, tracenum, i+j) == 0)
+			return 0;
+		    memset(p, index & 0xFF, size);
+		    trace->blocks[index] = p;
+		    trace->block_sizes[index] = size;
+		}
+	    }
+	    else {
+		for (j = 0; j < n; j++) {
+		    p = trace->blocks[trace->ops[i+j].index];
+		    remove_range(ranges, p);
+		    batch_ptrs[j] = p;
+		}
+		mm_free_batch(batch_ptrs, n);
+	    }
+	    i += n - 1;
+	    continue;
+	}
+
         switch (trace->ops[i].type) {
 
         case ALLOC: /* mm_malloc */
@@ -611,7 +1062,7 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
 	    
 	    /* 
 	     * Test the range of the new block for correctness and add it 
-	     * to the range list if OK. The block must be  be aligned properly,
+	     * to the range tree if OK. The block must be  be aligned properly,
 	     * and must not overlap any currently allocated block. 
 	     */ 
 	    if (add_range(ranges, p, size, tracenum, i) == 0)
@@ -638,10 +1089,10 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
 		return 0;
 	    }
 	    
-	    /* Remove the old region from the range list */
+	    /* Remove the old region from the range tree */
 	    remove_range(ranges, oldp);
 	    
-	    /* Check new block for correctness and add it to range list */
+	    /* Check new block for correctness and add it to range tree */
 	    if (add_range(ranges, newp, size, tracenum, i) == 0)
 		return 0;
 	    
@@ -653,7 +1104,7 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
 	    oldsize = trace->block_sizes[index];
 	    if (size < oldsize) oldsize = size;
 	    for (j = 0; j < oldsize; j++) {
-	      if (newp[j] != (index & 0xFF)) {
+	      if ((unsigned char)newp[j] != (index & 0xFF)) {
 		malloc_error(tracenum, i, "mm_realloc did not preserve the "
 			     "data from old block");
 		return 0;
@@ -689,19 +1140,21 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
  *   The idea is to remember the high water mark "hwm" of the heap for 
  *   an optimal allocator, i.e., no gaps and no internal fragmentation.
  *   Utilization is the ratio hwm/heapsize, where heapsize is the 
- *   size of the heap in bytes after running the student's malloc 
- *   package on the trace. Note that our implementation of mem_sbrk() 
- *   doesn't allow the students to decrement the brk pointer, so brk
- *   is always the high water mark of the heap. 
- *   
+ *   largest footprint (heap plus mem_mmap mappings) in bytes while
+ *   running the student's malloc package on the trace. Since the
+ *   package can shrink the heap and unmap, that is memlib's peak, not
+ *   the final brk. The footprint averaged over all ops, the steady
+ *   state, and the peak are returned in *avg_heap and *peak_heap.
  */
-static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
+static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges,
+			   double *avg_heap, double *peak_heap)
 {   
-    int i;
+    int i, j, n;
+    double heap_sum = 0;
     int index;
     int size, newsize, oldsize;
-    int max_total_size = 0;
-    int total_size = 0;
+    long max_total_size = 0;
+    long total_size = 0;
     char *p;
     char *newp, *oldp;
 
@@ -711,6 +1164,34 @@ static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
 	app_error("mm_init failed in eval_mm_util");
 
     for (i = 0;  i < trace->num_ops;  i++) {
+	/* In -b mode, a run of allocs or frees is one batch call */
+	if ((n = batch_len(trace, i)) > 1) {
+	    if (trace->ops[i].type == ALLOC) {
+		size = trace->ops[i].size;
+		if (mm_malloc_batch(size, n, batch_ptrs) < n)
+		    app_error("mm_malloc_batch failed in eval_mm_util");
+		for (j = 0; j < n; j++) {
+		    index = trace->ops[i+j].index;
+		    trace->blocks[index] = batch_ptrs[j];
+		    trace->block_sizes[index] = size;
+		}
+		total_size += (long)n * size;
+		max_total_size = (total_size > max_total_size) ?
+		    total_size : max_total_size;
+	    }
+	    else {
+		for (j = 0; j < n; j++) {
+		    index = trace->ops[i+j].index;
+		    batch_ptrs[j] = trace->blocks[index];
+		    total_size -= trace->block_sizes[index];
+		}
+		mm_free_batch(batch_ptrs, n);
+	    }
+	    heap_sum += (double)n * mem_footprint();
+	    i += n - 1;
+	    continue;
+	}
+
         switch (trace->ops[i].type) {
 
         case ALLOC: /* mm_alloc */
@@ -772,9 +1253,12 @@ static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
 	    app_error("Nonexistent request type in eval_mm_util");
 
         }
+	heap_sum += mem_footprint();
     }
 
-    return ((double)max_total_size / (double)mem_heapsize());
+    *avg_heap = heap_sum / trace->num_ops;
+    *peak_heap = mem_peak_footprint();
+    return ((double)max_total_size / (double)mem_peak_footprint());
 }
 
 
@@ -784,7 +1268,7 @@ static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
  */
 static void eval_mm_speed(void *ptr)
 {
-    int i, index, size, newsize;
+    int i, j, n, index, size, newsize;
     char *p, *newp, *oldp, *block;
     trace_t *trace = ((speed_t *)ptr)->trace;
 
@@ -794,7 +1278,24 @@ static void eval_mm_speed(void *ptr)
 	app_error("mm_init failed in eval_mm_speed");
 
     /* Interpret each trace request */
-    for (i = 0;  i < trace->num_ops;  i++)
+    for (i = 0;  i < trace->num_ops;  i++) {
+	/* In -b mode, a run of allocs or frees is one batch call */
+	if ((n = batch_len(trace, i)) > 1) {
+	    if (trace->ops[i].type == ALLOC) {
+		if (mm_malloc_batch(trace->ops[i].size, n, batch_ptrs) < n)
+		    app_error("mm_malloc_batch error in eval_mm_speed");
+		for (j = 0; j < n; j++)
+		    trace->blocks[trace->ops[i+j].index] = batch_ptrs[j];
+	    }
+	    else {
+		for (j = 0; j < n; j++)
+		    batch_ptrs[j] = trace->blocks[trace->ops[i+j].index];
+		mm_free_batch(batch_ptrs, n);
+	    }
+	    i += n - 1;
+	    continue;
+	}
+
         switch (trace->ops[i].type) {
 
         case ALLOC: /* mm_malloc */
@@ -823,6 +1324,507 @@ static void eval_mm_speed(void *ptr)
 	default:
 	    app_error("Nonexistent request type in eval_mm_valid");
         }
+    }
+}
+
+/*
+ * eval_mm_latency - Replay the trace once more, one op at a time even
+ *    in -b mode, timing every mm_malloc, mm_free and mm_realloc call
+ *    with clock.c's serialized counter and adding the cycles taken,
+ *    less the cost of reading the counter, to lat. This replay is separate from
+ *    the ones fsecs times, so the counter reads cost them nothing.
+ */
+static void eval_mm_latency(trace_t *trace, lat_t *lat)
+{
+    double cyc, ovhd = 1e30;
+    int i, index, type;
+    char *p;
+
+    /* The cost of reading the counter is the least of many tries */
+    for (i = 0; i < 1000; i++) {
+	start_counter();
+	if ((cyc = get_counter()) < ovhd)
+	    ovhd = cyc;
+    }
+
+    mem_reset_brk();
+    if (mm_init() < 0)
+	app_error("mm_init failed in eval_mm_latency");
+
+    for (i = 0;  i < trace->num_ops;  i++) {
+	type = trace->ops[i].type;
+	index = trace->ops[i].index;
+	switch (type) {
+	case ALLOC:
+	    start_counter();
+	    p = mm_malloc(trace->ops[i].size);
+	    cyc = get_counter();
+	    if (p == NULL)
+		app_error("mm_malloc error in eval_mm_latency");
+	    trace->blocks[index] = p;
+	    break;
+	case REALLOC:
+	    start_counter();
+	    p = mm_realloc(trace->blocks[index], trace->ops[i].size);
+	    cyc = get_counter();
+	    if (p == NULL)
+		app_error("mm_realloc error in eval_mm_latency");
+	    trace->blocks[index] = p;
+	    break;
+	case FREE:
+	    start_counter();
+	    mm_free(trace->blocks[index]);
+	    cyc = get_counter();
+	    break;
+	default:
+	    app_error("Nonexistent request type in eval_mm_latency");
+	}
+	hist_add(&lat->op[type], cyc > ovhd ? (unsigned long)(cyc - ovhd) : 0);
+    }
+}
+
+/*
+ * snapshot - Append a line describing the heap after op i to fp: the
+ *    footprint, what mm_snapshot reports and, of the live blocks, the
+ *    bytes requested and the bytes of padding by request size class
+ */
+static void snapshot(FILE *fp, trace_t *trace, int tracenum, int i)
+{
+    static mm_snap_t snap;
+    size_t live = 0, waste = 0, pad[32], used;
+    int j, k;
+
+    mm_snapshot(&snap);
+    memset(pad, 0, sizeof(pad));
+    for (j = 0; j < trace->num_ids; j++) {
+	if (trace->blocks[j] == NULL)
+	    continue;
+	live += trace->block_sizes[j];
+	if (mm_usable_size == NULL || trace->block_sizes[j] == 0)
+	    continue;
+	used = mm_usable_size(trace->blocks[j]);
+	k = 63 - __builtin_clzl(trace->block_sizes[j]);
+	pad[k] += used - trace->block_sizes[j];
+	waste += used - trace->block_sizes[j];
+    }
+
+    fprintf(fp, "%d %d %lu %lu %lu %lu %lu %lu %lu %lu %lu L", tracenum, i,
+	    (unsigned long)mem_footprint(), (unsigned long)snap.heap,
+	    (unsigned long)snap.free, (unsigned long)snap.nfree,
+	    (unsigned long)snap.largest, (unsigned long)snap.cached,
+	    (unsigned long)snap.slab_free, (unsigned long)live,
+	    (unsigned long)waste);
+    for (k = 0; k < MM_SNAP_CLASSES; k++)
+	if (snap.count[k])
+	    fprintf(fp, " %d:%lu:%lu", k, (unsigned long)snap.count[k],
+		    (unsigned long)snap.bytes[k]);
+    fprintf(fp, " W");
+    for (k = 0; k < 32; k++)
+	if (pad[k])
+	    fprintf(fp, " %d:%lu", k, (unsigned long)pad[k]);
+    fprintf(fp, "\n");
+}
+
+/*
+ * eval_mm_snapshots - Replay the trace once more, one op at a time,
+ *    and snapshot the heap before the first op, after every
+ *    snap_interval ops (by default SNAPS times in all) and after the
+ *    last. The snapshots are gathered in memory and appended to the
+ *    snapshot file with a single write.
+ */
+static void eval_mm_snapshots(trace_t *trace, int tracenum)
+{
+    int i, index, interval = snap_interval;
+    char *buf, *p;
+    size_t len;
+    FILE *fp;
+
+    if (interval == 0 && (interval = trace->num_ops / SNAPS) == 0)
+	interval = 1;
+    if ((fp = open_memstream(&buf, &len)) == NULL)
+	unix_error("open_memstream error in eval_mm_snapshots");
+    memset(trace->blocks, 0, trace->num_ids * sizeof(char *));
+
+    mem_reset_brk();
+    if (mm_init() < 0)
+	app_error("mm_init failed in eval_mm_snapshots");
+    snapshot(fp, trace, tracenum, 0);
+
+    for (i = 0;  i < trace->num_ops;  i++) {
+	index = trace->ops[i].index;
+	switch (trace->ops[i].type) {
+	case ALLOC:
+	case REALLOC:
+	    p = trace->ops[i].type == ALLOC ? 
+		mm_malloc(trace->ops[i].size) :
+		mm_realloc(trace->blocks[index], trace->ops[i].size);
+	    if (p == NULL)
+		app_error("allocation failed in eval_mm_snapshots");
+	    trace->blocks[index] = p;
+	    trace->block_sizes[index] = trace->ops[i].size;
+	    break;
+	case FREE:
+	    mm_free(trace->blocks[index]);
+	    trace->blocks[index] = NULL;
+	    break;
+	default:
+	    app_error("Nonexistent request type in eval_mm_snapshots");
+	}
+	if ((i + 1) % interval == 0 || i + 1 == trace->num_ops)
+	    snapshot(fp, trace, tracenum, i + 1);
+    }
+
+    if (fclose(fp) != 0 || write(snap_fd, buf, len) != (ssize_t)len)
+	unix_error("write error in eval_mm_snapshots");
+    free(buf);
+}
+
+/*
+ * eval_mm_mt - Replay the trace on nthreads threads at once, each
+ *    thread with its own set of blocks, and return the average wall
+ *    clock time of MT_RUNS such replays. Returns 0 if the heap ran out.
+ *    Correctness is not checked here; that is eval_mm_valid's job.
+ */
+static double eval_mm_mt(trace_t *trace, int nthreads)
+{
+    pthread_t tids[MAXTHREADS];
+    mt_thread_t args[MAXTHREADS];
+    struct timeval stv, etv;
+    double secs = 0;
+    int i, run, failed = 0;
+
+    for (i = 0; i < nthreads; i++) {
+	args[i].trace = trace;
+	if ((args[i].blocks = 
+	     (char **)malloc(trace->num_ids * sizeof(char *))) == NULL)
+	    unix_error("malloc failed in eval_mm_mt");
+    }
+
+    for (run = 0; run < MT_RUNS && !failed; run++) {
+	mem_reset_brk();
+	if (mm_init() < 0)
+	    app_error("mm_init failed in eval_mm_mt");
+
+	gettimeofday(&stv, NULL);
+	for (i = 0; i < nthreads; i++) {
+	    args[i].failed = 0;
+	    if (pthread_create(&tids[i], NULL, mt_replay, &args[i]) != 0)
+		unix_error("pthread_create failed in eval_mm_mt");
+	}
+	for (i = 0; i < nthreads; i++) {
+	    pthread_join(tids[i], NULL);
+	    failed |= args[i].failed;
+	}
+	gettimeofday(&etv, NULL);
+	secs += (etv.tv_sec - stv.tv_sec) + 1E-6*(etv.tv_usec - stv.tv_usec);
+    }
+
+    for (i = 0; i < nthreads; i++)
+	free(args[i].blocks);
+    return failed ? 0 : secs / MT_RUNS;
+}
+
+/*
+ * mt_replay - Thread body for eval_mm_mt. Same as eval_mm_speed,
+ *    except that the heap is shared and already initialized.
+ */
+static void *mt_replay(void *arg)
+{
+    mt_thread_t *t = (mt_thread_t *)arg;
+    trace_t *trace = t->trace;
+    char **blocks = t->blocks;
+    char *p;
+    int i;
+
+    for (i = 0;  i < trace->num_ops;  i++) {
+	switch (trace->ops[i].type) {
+
+	case ALLOC: /* mm_malloc */
+	    if ((p = mm_malloc(trace->ops[i].size)) == NULL) {
+		t->failed = 1;
+		return NULL;
+	    }
+	    blocks[trace->ops[i].index] = p;
+	    break;
+
+	case REALLOC: /* mm_realloc */
+	    p = mm_realloc(blocks[trace->ops[i].index], trace->ops[i].size);
+	    if (p == NULL) {
+		t->failed = 1;
+		return NULL;
+	    }
+	    blocks[trace->ops[i].index] = p;
+	    break;
+
+	case FREE: /* mm_free */
+	    mm_free(blocks[trace->ops[i].index]);
+	    break;
+
+	default:
+	    app_error("Nonexistent request type in mt_replay");
+	}
+    }
+    return NULL;
+}
+
+/*
+ * batch_len - In -b mode, the number of ops starting at op i that go
+ *    to the mm package as one batch: a run of frees, or a run of allocs
+ *    of the same size, at most batch long. 0 when -b is off.
+ */
+static int batch_len(trace_t *trace, int i)
+{
+    traceop_t *op = &trace->ops[i];
+    int n = 1;
+
+    if (!batch || op->type == REALLOC)
+	return 0;
+    while (n < batch && i + n < trace->num_ops && op[n].type == op->type &&
+	   (op->type == FREE || op[n].size == op->size))
+	n++;
+    return n;
+}
+
+/*
+ * eval_mm_trace - Evaluate the mm package on one trace file: its
+ *     correctness and, if it is correct, its utilization, its speed,
+ *     (for -T) its speed on each of the nlevels thread counts, which
+ *     go to mt_secs[0], mt_secs[stride], ..., (for -P) the hardware
+ *     events of its replays, (for -S) the time of each of its timed
+ *     replays, (for -L, when lat is not NULL) the latencies of its
+ *     ops and (for -F) snapshots of the heap
+ */
+static void eval_mm_trace(char *tracefile, int tracenum, range_t **ranges,
+			  stats_t *stats, int nlevels, int *threads,
+			  double *mt_secs, int stride, lat_t *lat)
+{
+    trace_t *trace;
+    speed_t speed_params;
+    int j;
+
+    trace = read_trace(tracedir, tracefile);
+    stats->ops = trace->num_ops;
+    if (verbose > 1)
+	printf("Checking mm_malloc for correctness, ");
+    stats->valid = eval_mm_valid(trace, tracenum, ranges);
+    if (stats->valid) {
+	if (verbose > 1)
+	    printf("efficiency, ");
+	stats->util = eval_mm_util(trace, tracenum, ranges,
+				   &stats->avg_heap, &stats->peak_heap);
+	speed_params.trace = trace;
+	speed_params.ranges = *ranges;
+	if (verbose > 1)
+	    printf("and performance.\n");
+	stats->secs = fsecs(eval_mm_speed, &speed_params);
+	if (perf_events)
+	    fperf(eval_mm_speed, &speed_params, PERF_RUNS, stats->events);
+	if (runs)
+	    fsecs_samples(eval_mm_speed, &speed_params, runs, stats->run_secs);
+	for (j = 0; j < nlevels; j++)
+	    mt_secs[j*stride] = eval_mm_mt(trace, threads[j]);
+	if (lat)
+	    eval_mm_latency(trace, lat);
+	if (snap_fd >= 0)
+	    eval_mm_snapshots(trace, tracenum);
+    }
+    free_trace(trace);
+}
+
+/*
+ * eval_mm_parallel - Evaluate the n traces on njobs worker processes.
+ *     Each worker is a fork of mdriver with its own copy of the
+ *     simulated memory system and of the mm package's state. Workers
+ *     take trace numbers from a counter they share, so a slow trace
+ *     holds up only its own worker, fill in the trace's job_result_t
+ *     in a shared array, and then send the trace number over a pipe.
+ *     Every worker is pinned to its own CPU, as far as there are CPUs,
+ *     so that its timings are not disturbed by migrations. A trace
+ *     whose worker dies counts as incorrect.
+ */
+static void eval_mm_parallel(int njobs, char **tracefiles, int n,
+			     range_t **ranges, stats_t *stats, int nlevels,
+			     int *threads, double *mt_secs, lat_t *lat)
+{
+    job_result_t *results, *res;
+    cpu_set_t cpus, one;
+    size_t len = n * sizeof(job_result_t) + sizeof(int);
+    int *next, *done;
+    int fd[2], w, i, j, cpu = -1;
+    pid_t pid;
+
+    /* The results, followed by the trace counter */
+    if ((results = mmap(NULL, len, PROT_READ|PROT_WRITE,
+			MAP_SHARED|MAP_ANONYMOUS, -1, 0)) == MAP_FAILED)
+	unix_error("mmap error in eval_mm_parallel");
+    next = (int *)(results + n);
+    *next = 0;
+    if (pipe(fd) < 0)
+	unix_error("pipe error in eval_mm_parallel");
+    if (sched_getaffinity(0, sizeof(cpus), &cpus) < 0)
+	CPU_ZERO(&cpus);
+    fflush(stdout);  /* or each worker prints it again */
+
+    for (w = 0; w < njobs; w++) {
+	if (CPU_COUNT(&cpus) > 0)  /* next allowed CPU, round robin */
+	    do
+		cpu = (cpu + 1) % CPU_SETSIZE;
+	    while (!CPU_ISSET(cpu, &cpus));
+	if ((pid = fork()) < 0)
+	    unix_error("fork error in eval_mm_parallel");
+	if (pid > 0)
+	    continue;
+
+	/* Worker */
+	close(fd[0]);
+	if (cpu >= 0) {
+	    CPU_ZERO(&one);
+	    CPU_SET(cpu, &one);
+	    sched_setaffinity(0, sizeof(one), &one);
+	}
+	while ((i = __sync_fetch_and_add(next, 1)) < n) {
+	    res = &results[i];
+	    errors = 0;
+	    eval_mm_trace(tracefiles[i], i, ranges, &res->stats, nlevels,
+			  threads, res->mt_secs, 1, lat ? &res->lat : NULL);
+	    res->errors = errors;
+	    fflush(stdout);
+	    if (write(fd[1], &i, sizeof(int)) != sizeof(int))
+		unix_error("write error in eval_mm_parallel");
+	}
+	exit(0);
+    }
+
+    /* Gather the results until every worker has closed the pipe */
+    close(fd[1]);
+    if ((done = (int *)calloc(n, sizeof(int))) == NULL)
+	unix_error("done calloc in eval_mm_parallel failed");
+    while (read(fd[0], &i, sizeof(int)) == sizeof(int)) {
+	res = &results[i];
+	stats[i] = res->stats;
+	for (j = 0; j < nlevels; j++)
+	    mt_secs[j*n + i] = res->mt_secs[j];
+	if (lat)
+	    lat[i] = res->lat;
+	errors += res->errors;
+	done[i] = 1;
+    }
+    close(fd[0]);
+    while (wait(NULL) > 0)
+	;
+
+    for (i = 0; i < n; i++)
+	if (!done[i]) {
+	    errors++;
+	    stats[i].valid = 0;
+	    printf("ERROR [trace %d]: worker process died\n", i);
+	}
+    free(done);
+    munmap(results, len);
+}
+
+/*
+ * select_policy - Column p of -A: placement policy p of mm.c, with
+ *     best-fit looking at up to k blocks
+ */
+static void select_policy(int p, int k)
+{
+    mm_set_policy(p, k);
+}
+
+/*
+ * select_variant - Column v of -K: compile-time variant v
+ */
+static void select_variant(int v, int k)
+{
+    mm_set_variant(v);
+}
+
+/*
+ * eval_mm_matrix - Evaluate the correctness, utilization and speed
+ *     of the n traces under each of the ncols configurations of the
+ *     mm package in turn, set up by setup(col, k), and print them
+ *     side by side under names[col] with each one's performance
+ *     index. The caller restores the configuration it wants after.
+ */
+static void eval_mm_matrix(char **tracefiles, int n, range_t **ranges,
+			   char **names, int ncols, void (*setup)(int, int),
+			   int k)
+{
+    stats_t *stats, *st;
+    trace_t *trace;
+    speed_t speed_params;
+    double *util, *secs, ops = 0, thru;
+    int i, p;
+
+    if ((stats = (stats_t *)calloc(ncols * n, sizeof(stats_t))) == NULL)
+	unix_error("stats calloc in eval_mm_matrix failed");
+    if ((util = (double *)calloc(2 * ncols, sizeof(double))) == NULL)
+	unix_error("util calloc in eval_mm_matrix failed");
+    secs = util + ncols;
+    for (i = 0; i < n; i++) {
+	trace = read_trace(tracedir, tracefiles[i]);
+	ops += trace->num_ops;
+	for (p = 0; p < ncols; p++) {
+	    setup(p, k);
+	    st = &stats[p*n + i];
+	    st->ops = trace->num_ops;
+	    if (!(st->valid = eval_mm_valid(trace, i, ranges)))
+		continue;
+	    st->util = eval_mm_util(trace, i, ranges,
+				    &st->avg_heap, &st->peak_heap);
+	    speed_params.trace = trace;
+	    speed_params.ranges = *ranges;
+	    st->secs = fsecs(eval_mm_speed, &speed_params);
+	}
+	free_trace(trace);
+    }
+
+    printf("%5s", "trace");
+    for (p = 0; p < ncols; p++) {
+	printf("%13s", names[p]);
+	util[p] = secs[p] = 0;
+    }
+    printf("\n");
+    for (i = 0; i < n; i++) {
+	printf("%2d   ", i);
+	for (p = 0; p < ncols; p++) {
+	    st = &stats[p*n + i];
+	    if (!st->valid) {
+		printf("%13s", "-");
+		util[p] = -1;
+		continue;
+	    }
+	    printf("%5.0f%%%7.0f", st->util * 100, st->ops / st->secs / 1e3);
+	    if (util[p] >= 0) {
+		util[p] += st->util;
+		secs[p] += st->secs;
+	    }
+	}
+	printf("\n");
+    }
+
+    printf("%5s", "Total");
+    for (p = 0; p < ncols; p++)
+	if (util[p] < 0)
+	    printf("%13s", "-");
+	else
+	    printf("%5.0f%%%7.0f", util[p] / n * 100, ops / secs[p] / 1e3);
+    printf("\n%5s", "Index");
+    for (p = 0; p < ncols; p++) {
+	if (util[p] < 0) {
+	    printf("%13s", "-");
+	    continue;
+	}
+	thru = ops / secs[p] / AVG_LIBC_THRUPUT;
+	if (thru > 1)
+	    thru = 1;
+	printf("%13.0f", 100 * (UTIL_WEIGHT * util[p] / n + 
+				(1 - UTIL_WEIGHT) * thru));
+    }
+    printf("\n");
+    free(util);
+    free(stats);
 }
 
 /*
@@ -972,6 +1974,224 @@ static void printresults(int n, stats_t *stats)
 
 }
 
+/*
+ * printmtresults - prints aggregate throughput (all threads together)
+ *    for each trace and each thread count of the -T mode
+ */
+static void printmtresults(int n, stats_t *stats, int nlevels, 
+			   int *threads, double *mt_secs)
+{
+    int i, j;
+    double secs;
+
+    printf("%5s", "trace");
+    for (j = 0; j < nlevels; j++)
+	printf("%7dT", threads[j]);
+    printf("\n");
+    for (i = 0; i < n; i++) {
+	printf("%2d   ", i);
+	for (j = 0; j < nlevels; j++) {
+	    secs = mt_secs[j*n + i];
+	    if (stats[i].valid && secs > 0)
+		printf("%8.0f", (threads[j] * stats[i].ops/1e3) / secs);
+	    else
+		printf("%8s", "-");
+	}
+	printf("\n");
+    }
+}
+
+/*
+ * printheapresults - prints the average and peak heap size of the mm
+ *    package for each trace, and how much of the peak it gave back
+ *    on average
+ */
+static void printheapresults(int n, stats_t *stats)
+{
+    int i;
+    double avg = 0, peak = 0;
+
+    printf("%5s%12s%12s%8s\n", "trace", "avg", "peak", "avg/pk");
+    for (i = 0; i < n; i++) {
+	if (stats[i].valid) {
+	    printf("%2d%15.1f%12.1f%7.0f%%\n", i,
+		   stats[i].avg_heap/1024, stats[i].peak_heap/1024,
+		   100.0 * stats[i].avg_heap / stats[i].peak_heap);
+	    avg += stats[i].avg_heap;
+	    peak += stats[i].peak_heap;
+	}
+	else
+	    printf("%2d%15s%12s%8s\n", i, "-", "-", "-");
+    }
+    if (errors == 0 && peak > 0)
+	printf("%5s%12.1f%12.1f%7.0f%%\n", "Total",
+	       avg/1024, peak/1024, 100.0 * avg / peak);
+}
+
+/*
+ * printlatresults - prints the median, tail and largest latency of
+ *    each type of op in each trace
+ */
+static void printlatresults(int n, stats_t *stats, lat_t *lat)
+{
+    hist_t *h;
+    int i, t;
+
+    printf("%5s  %-8s%9s%8s%8s%8s%10s\n",
+	   "trace", "op", "ops", "p50", "p99", "p99.9", "max");
+    for (i = 0; i < n; i++) {
+	if (!stats[i].valid) {
+	    printf("%2d%7s\n", i, "-");
+	    continue;
+	}
+	for (t = ALLOC; t <= REALLOC; t++) {
+	    if ((h = &lat[i].op[t])->n == 0)
+		continue;
+	    printf("%2d     %-8s%9lu%8lu%8lu%8lu%10lu\n", i, op_names[t], h->n,
+		   hist_quantile(h, 0.5), hist_quantile(h, 0.99),
+		   hist_quantile(h, 0.999), h->max);
+	}
+    }
+}
+
+/*
+ * printperfresults - prints the hardware events per op of each trace,
+ *    and the instructions per cycle; "-" marks events not counted
+ */
+static void printperfresults(int n, stats_t *stats)
+{
+    double *ev, ops = 0, total[FPERF_EVENTS];
+    int i, e;
+
+    printf("%5s", "trace");
+    for (e = 0; e < FPERF_EVENTS; e++)
+	printf("%10s", fperf_names[e]);
+    printf("%6s\n", "IPC");
+    for (e = 0; e < FPERF_EVENTS; e++)
+	total[e] = 0;
+
+    for (i = 0; i < n; i++) {
+	printf("%2d   ", i);
+	if (!stats[i].valid) {
+	    printf("%10s\n", "-");
+	    continue;
+	}
+	ev = stats[i].events;
+	for (e = 0; e < FPERF_EVENTS; e++) {
+	    if (ev[e] < 0)
+		printf("%10s", "-");
+	    else
+		printf("%10.2f", ev[e] / stats[i].ops);
+	    total[e] = (ev[e] < 0 || total[e] < 0) ? -1 : total[e] + ev[e];
+	}
+	if (ev[0] > 0 && ev[1] >= 0)
+	    printf("%6.2f\n", ev[1] / ev[0]);
+	else
+	    printf("%6s\n", "-");
+	ops += stats[i].ops;
+    }
+
+    if (errors == 0 && ops > 0) {
+	printf("%5s", "Total");
+	for (e = 0; e < FPERF_EVENTS; e++)
+	    if (total[e] < 0)
+		printf("%10s", "-");
+	    else
+		printf("%10.2f", total[e] / ops);
+	if (total[0] > 0 && total[1] >= 0)
+	    printf("%6.2f\n", total[1] / total[0]);
+	else
+	    printf("%6s\n", "-");
+    }
+}
+
+/*
+ * write_histograms - writes the latency histograms of the valid traces
+ *    to a CSV file, one line per non-empty bucket
+ */
+static void write_histograms(char *path, int n, stats_t *stats, lat_t *lat)
+{
+    FILE *fp;
+    hist_t *h;
+    int i, t, b;
+
+    if ((fp = fopen(path, "w")) == NULL) {
+	sprintf(msg, "Could not open %s in write_histograms", path);
+	unix_error(msg);
+    }
+    fprintf(fp, "trace,op,lo,hi,count\n");
+    for (i = 0; i < n; i++)
+	for (t = ALLOC; stats[i].valid && t <= REALLOC; t++)
+	    for (h = &lat[i].op[t], b = 0; b < HIST_BUCKETS; b++)
+		if (h->count[b])
+		    fprintf(fp, "%d,%s,%lu,%lu,%lu\n", i, op_names[t],
+			    hist_bucket_lo(b), hist_bucket_hi(b), h->count[b]);
+    if (fclose(fp) != 0)
+	unix_error("fclose error in write_histograms");
+}
+
+/*
+ * printrunresults - prints the median throughput of the timed replays
+ *    of each trace, its spread (MAD, as a percentage of the median),
+ *    its confidence interval and the number of outliers. The Total
+ *    line treats replay j of every trace as one run of all of them.
+ */
+static void printrunresults(int n, stats_t *stats)
+{
+    double kops[MAXRUNS], secs[MAXRUNS], ops = 0;
+    fstats_t s;
+    int i, j;
+
+    printf("%5s%9s%7s%9s%9s%6s\n",
+	   "trace", "median", "MAD", "lo", "hi", "out");
+    for (j = 0; j < runs; j++)
+	secs[j] = 0;
+    for (i = 0; i < n; i++) {
+	if (!stats[i].valid) {
+	    printf("%2d%10s\n", i, "-");
+	    continue;
+	}
+	for (j = 0; j < runs; j++) {
+	    kops[j] = stats[i].ops / stats[i].run_secs[j] / 1e3;
+	    secs[j] += stats[i].run_secs[j];
+	}
+	ops += stats[i].ops;
+	fstats(kops, runs, &s);
+	printf("%2d%12.0f%6.1f%%%9.0f%9.0f%6d\n", i, s.median,
+	       100 * s.mad / s.median, s.lo, s.hi, s.outliers);
+    }
+
+    if (errors == 0 && ops > 0) {
+	for (j = 0; j < runs; j++)
+	    kops[j] = ops / secs[j] / 1e3;
+	fstats(kops, runs, &s);
+	printf("%5s%9.0f%6.1f%%%9.0f%9.0f%6d\n", "Total", s.median,
+	       100 * s.mad / s.median, s.lo, s.hi, s.outliers);
+    }
+}
+
+/*
+ * write_samples - writes the time of every timed replay of the valid
+ *    traces to a CSV file, one line per replay, for abtest
+ */
+static void write_samples(char *path, int n, stats_t *stats)
+{
+    FILE *fp;
+    int i, j;
+
+    if ((fp = fopen(path, "w")) == NULL) {
+	sprintf(msg, "Could not open %s in write_samples", path);
+	unix_error(msg);
+    }
+    fprintf(fp, "trace,ops,run,secs\n");
+    for (i = 0; i < n; i++)
+	for (j = 0; stats[i].valid && j < runs; j++)
+	    fprintf(fp, "%d,%.0f,%d,%.9f\n", i, stats[i].ops, j,
+		    stats[i].run_secs[j]);
+    if (fclose(fp) != 0)
+	unix_error("fclose error in write_samples");
+}
+
 /* 
  * app_error - Report an arbitrary application error
  */
@@ -999,19 +2219,51 @@ void malloc_error(int tracenum, int opnum, char *msg)
     printf("ERROR [trace %d, line %d]: %s\n", tracenum, LINENUM(opnum), msg);
 }
 
+/*
+ * parse_bytes - A byte count with an optional K, M or G suffix, or 0
+ *     if s is not one
+ */
+static size_t parse_bytes(char *s)
+{
+    char *end;
+    double n = strtod(s, &end);
+
+    switch (*end) {
+    case 'K': case 'k': n *= 1 << 10; end++; break;
+    case 'M': case 'm': n *= 1 << 20; end++; break;
+    case 'G': case 'g': n *= 1 << 30; end++; break;
+    }
+    return (*end || n < 1) ? 0 : (size_t)n;
+}
+
 /* 
  * usage - Explain the command line arguments
  */
 static void usage(void) 
 {
-    fprintf(stderr, "Usage: mdriver [-hvVal] [-f <file>] [-t <dir>]\n");
+    fprintf(stderr, "Usage: mdriver [-hvVal] [-f <file>] [-t <dir>] [-T <n>] [-b <n>] [-j <n>] [-L] [-H <file>] [-P] [-S <n>] [-O <file>]\n"
+	    "               [-F <file>] [-I <n>] [-M <bytes>] [-p <policy>] [-A] [-K]\n");
     fprintf(stderr, "Options\n");
     fprintf(stderr, "\t-a         Don't check the team structure.\n");
+    fprintf(stderr, "\t-A         Also compare every placement policy of mm.c.\n");
+    fprintf(stderr, "\t-b <n>     Issue runs of up to n allocs or frees as batch calls.\n");
     fprintf(stderr, "\t-f <file>  Use <file> as the trace file.\n");
+    fprintf(stderr, "\t-F <file>  Write heap snapshots taken during replay to <file>.\n");
     fprintf(stderr, "\t-g         Generate summary info for autograder.\n");
     fprintf(stderr, "\t-h         Print this message.\n");
+    fprintf(stderr, "\t-H <file>  Like -L, and write the latency histograms to a CSV file.\n");
+    fprintf(stderr, "\t-I <n>     Take the -F snapshots every n ops (default: %d per trace).\n", SNAPS);
+    fprintf(stderr, "\t-j <n>     Evaluate the traces on n worker processes.\n");
+    fprintf(stderr, "\t-K         Also compare every compile-time variant (mdriver-variants).\n");
     fprintf(stderr, "\t-l         Run libc malloc as well.\n");
+    fprintf(stderr, "\t-L         Report the p50/p99/p99.9/max latency of each op type.\n");
+    fprintf(stderr, "\t-M <bytes> Let the heap grow to <bytes> (e.g. 4G) instead of %d MB.\n", MAX_HEAP >> 20);
+    fprintf(stderr, "\t-O <file>  Like -S, and write the replay times to a CSV file.\n");
+    fprintf(stderr, "\t-p <pol>   Placement policy of mm.c: lifo, address, bestfit[:k] or nextfit.\n");
+    fprintf(stderr, "\t-P         Count cycles, instructions, cache, TLB and branch misses per op.\n");
+    fprintf(stderr, "\t-S <n>     Time n replays of each trace; report median, MAD and CI.\n");
     fprintf(stderr, "\t-t <dir>   Directory to find default traces.\n");
+    fprintf(stderr, "\t-T <n>     Also replay each trace on 1, 2, 4, ..., n threads.\n");
     fprintf(stderr, "\t-v         Print per-trace performance breakdowns.\n");
     fprintf(stderr, "\t-V         Print additional debug info.\n");
 }
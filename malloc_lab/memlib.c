@@ -1,3 +1,4 @@
+#define _GNU_SOURCE  /* for mremap */
 /*
  * memlib.c - a module that simulates the memory system.  Needed because it 
  *            allows us to interleave calls from the student's malloc package 
@@ -18,20 +19,50 @@
 static char *mem_start_brk;  /* points to first byte of heap */
 static char *mem_brk;        /* points to last byte of heap */
 static char *mem_max_addr;   /* largest legal heap address */ 
+static size_t mem_max_heap = MAX_HEAP; /* bytes the heap may grow to */
+static size_t mem_peak;      /* largest footprint since the last reset */
+
+/* Simulated mmap: live mappings, made with the real mmap so that
+   mem_mremap can move them without copying */
+typedef struct {
+    char *addr;
+    size_t len;
+} mapping_t;
+static mapping_t *mem_maps;  /* the live mappings... */
+static int mem_nmaps;        /* ...how many there are... */
+static int mem_maxmaps;      /* ...and how many fit in mem_maps */
+static size_t mem_mapped;    /* bytes in all live mappings */
+
+static void mem_update_peak(void);
+static mapping_t *mem_find_map(char *addr);
+
+/*
+ * mem_set_max_heap - set the most bytes the heap may grow to, in place
+ *    of MAX_HEAP; call it before mem_init
+ */
+void mem_set_max_heap(size_t bytes)
+{
+    mem_max_heap = bytes;
+}
 
 /* 
  * mem_init - initialize the memory system model
  */
 void mem_init(void)
 {
-    /* allocate the storage we will use to model the available VM */
-    if ((mem_start_brk = (char *)malloc(MAX_HEAP)) == NULL) {
-	fprintf(stderr, "mem_init_vm: malloc error\n");
+    /* reserve the storage we will use to model the available VM; its
+       pages only take up memory once the heap grows over them, so a
+       large maximum costs nothing until it is used */
+    mem_start_brk = mmap(NULL, mem_max_heap, PROT_READ|PROT_WRITE,
+			 MAP_PRIVATE|MAP_ANONYMOUS|MAP_NORESERVE, -1, 0);
+    if (mem_start_brk == MAP_FAILED) {
+	fprintf(stderr, "mem_init_vm: mmap error\n");
 	exit(1);
     }
 
-    mem_max_addr = mem_start_brk + MAX_HEAP;  /* max legal heap address */
+    mem_max_addr = mem_start_brk + mem_max_heap;  /* max legal heap address */
     mem_brk = mem_start_brk;                  /* heap is empty initially */
+    mem_peak = 0;
 }
 
 /* 
@@ -39,35 +70,165 @@ void mem_init(void)
  */
 void mem_deinit(void)
 {
-    free(mem_start_brk);
+    mem_reset_brk();
+    munmap(mem_start_brk, mem_max_heap);
+    free(mem_maps);
 }
 
 /*
- * mem_reset_brk - reset the simulated brk pointer to make an empty heap
+ * mem_reset_brk - reset the simulated brk pointer to make an empty heap,
+ *    and drop any simulated mappings along with it
  */
 void mem_reset_brk()
 {
+    while (mem_nmaps > 0) {
+	mem_nmaps--;
+	munmap(mem_maps[mem_nmaps].addr, mem_maps[mem_nmaps].len);
+    }
+    mem_mapped = 0;
     mem_brk = mem_start_brk;
+    mem_peak = 0;
 }
 
 /* 
  * mem_sbrk - simple model of the sbrk function. Extends the heap 
- *    by incr bytes and returns the start address of the new area. In
- *    this model, the heap cannot be shrunk.
+ *    by incr bytes and returns the start address of the new area. A
+ *    negative incr shrinks the heap by -incr bytes and returns the old
+ *    break, like sbrk. Only the break and the footprint it accounts for
+ *    go down: the model heap is one fixed region, so the bytes stay
+ *    resident and are reused when the heap grows again.
  */
-void *mem_sbrk(int incr) 
+void *mem_sbrk(intptr_t incr) 
 {
     char *old_brk = mem_brk;
 
-    if ( (incr < 0) || ((mem_brk + incr) > mem_max_addr)) {
+    if (incr < 0 && (mem_brk - mem_start_brk) < -incr) {
+	errno = EINVAL;
+	fprintf(stderr, "ERROR: mem_sbrk failed. Shrunk below the heap start...\n");
+	return (void *)-1;
+    }
+    if (incr > mem_max_addr - mem_brk) {
 	errno = ENOMEM;
 	fprintf(stderr, "ERROR: mem_sbrk failed. Ran out of memory...\n");
 	return (void *)-1;
     }
     mem_brk += incr;
+    mem_update_peak();
     return (void *)old_brk;
 }
 
+/*
+ * mem_mmap - model of an anonymous mmap outside the heap. Maps len
+ *    bytes (a multiple of the page size) and returns their address,
+ *    or (void *)-1 if it fails.
+ */
+void *mem_mmap(size_t len)
+{
+    char *p;
+
+    if (mem_nmaps == mem_maxmaps) {
+	mem_maxmaps = mem_maxmaps ? 2*mem_maxmaps : 16;
+	if ((mem_maps = realloc(mem_maps, 
+				mem_maxmaps * sizeof(mapping_t))) == NULL) {
+	    fprintf(stderr, "ERROR: mem_mmap failed. realloc error\n");
+	    exit(1);
+	}
+    }
+    p = mmap(NULL, len, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED) {
+	fprintf(stderr, "ERROR: mem_mmap failed. Ran out of memory...\n");
+	return (void *)-1;
+    }
+    mem_maps[mem_nmaps].addr = p;
+    mem_maps[mem_nmaps].len = len;
+    mem_nmaps++;
+    mem_mapped += len;
+    mem_update_peak();
+    return p;
+}
+
+/*
+ * mem_munmap - Unmap the whole mapping at addr made by mem_mmap.
+ *    Returns 0, or -1 if there is no such mapping.
+ */
+int mem_munmap(void *addr)
+{
+    mapping_t *m;
+
+    if ((m = mem_find_map(addr)) == NULL) {
+	errno = EINVAL;
+	fprintf(stderr, "ERROR: mem_munmap failed. No mapping at %p\n", addr);
+	return -1;
+    }
+    munmap(m->addr, m->len);
+    mem_mapped -= m->len;
+    *m = mem_maps[--mem_nmaps];
+    return 0;
+}
+
+/*
+ * mem_mremap - Resize the mapping at addr to len bytes, moving it
+ *    (without copying) if it cannot grow where it is. Returns its new
+ *    address, or (void *)-1 if it fails.
+ */
+void *mem_mremap(void *addr, size_t len)
+{
+    mapping_t *m;
+    char *p;
+
+    if ((m = mem_find_map(addr)) == NULL) {
+	errno = EINVAL;
+	fprintf(stderr, "ERROR: mem_mremap failed. No mapping at %p\n", addr);
+	return (void *)-1;
+    }
+    if ((p = mremap(m->addr, m->len, len, MREMAP_MAYMOVE)) == MAP_FAILED) {
+	fprintf(stderr, "ERROR: mem_mremap failed. Ran out of memory...\n");
+	return (void *)-1;
+    }
+    mem_mapped += len - m->len;
+    m->addr = p;
+    m->len = len;
+    mem_update_peak();
+    return p;
+}
+
+/*
+ * mem_is_mapped - returns true if the bytes lo..hi lie inside a single
+ *    live mapping
+ */
+int mem_is_mapped(void *lo, void *hi)
+{
+    int i;
+
+    for (i = 0; i < mem_nmaps; i++)
+	if ((char *)lo >= mem_maps[i].addr && 
+	    (char *)hi < mem_maps[i].addr + mem_maps[i].len)
+	    return 1;
+    return 0;
+}
+
+/*
+ * mem_find_map - the live mapping that starts at addr, or NULL
+ */
+static mapping_t *mem_find_map(char *addr)
+{
+    int i;
+
+    for (i = 0; i < mem_nmaps; i++)
+	if (mem_maps[i].addr == addr)
+	    return &mem_maps[i];
+    return NULL;
+}
+
+/*
+ * mem_update_peak - note a new footprint high water mark
+ */
+static void mem_update_peak(void)
+{
+    if (mem_footprint() > mem_peak)
+	mem_peak = mem_footprint();
+}
+
 /*
  * mem_heap_lo - return address of the first heap byte
  */
@@ -92,6 +253,32 @@ size_t mem_heapsize()
     return (size_t)(mem_brk - mem_start_brk);
 }
 
+/*
+ * mem_mapsize() - returns the bytes in all simulated mappings
+ */
+size_t mem_mapsize() 
+{
+    return mem_mapped;
+}
+
+/*
+ * mem_footprint() - returns the heap size plus the mapped bytes, the
+ *    memory the malloc package holds
+ */
+size_t mem_footprint() 
+{
+    return mem_heapsize() + mem_mapped;
+}
+
+/*
+ * mem_peak_footprint() - returns the largest footprint in bytes since
+ *    the last mem_reset_brk
+ */
+size_t mem_peak_footprint() 
+{
+    return mem_peak;
+}
+
 /*
  * mem_pagesize() - returns the page size of the system
  */
@@ -1,11 +1,20 @@
 #include <unistd.h>
+#include <stdint.h>
 
+void mem_set_max_heap(size_t bytes);
 void mem_init(void);               
 void mem_deinit(void);
-void *mem_sbrk(int incr);
+void *mem_sbrk(intptr_t incr);
+void *mem_mmap(size_t len);
+int mem_munmap(void *addr);
+void *mem_mremap(void *addr, size_t len);
+int mem_is_mapped(void *lo, void *hi);
 void mem_reset_brk(void); 
 void *mem_heap_lo(void);
 void *mem_heap_hi(void);
 size_t mem_heapsize(void);
+size_t mem_mapsize(void);
+size_t mem_footprint(void);
+size_t mem_peak_footprint(void);
 size_t mem_pagesize(void);
 
@@ -0,0 +1,396 @@
+/*
+ * mm-tlsf.c - Two-level segregated fit (TLSF) allocator.
+ *
+ * Free blocks are kept in FL_COUNT x SL_COUNT segregated lists. The
+ * first level splits sizes by powers of two, the second level cuts
+ * each power of two into SL_COUNT equal ranges. Two levels of bitmaps
+ * record which lists are non-empty, so both malloc and free run in a
+ * bounded number of steps, independent of the number of free blocks:
+ *
+ *   malloc: round the request up to the next list boundary, find the
+ *           first non-empty list at or above it with two find-first-set
+ *           instructions, take its head and split off the remainder.
+ *   free:   coalesce with the physical neighbours and push the result
+ *           on the head of its list.
+ *
+ * Blocks have a one-word header; the payload follows it:
+ *
+ *      header     payload ...                          (prev_phys)
+ *     -------------------------------------------------------------
+ *    | size|p|f | next_free | prev_free |   ...   | size (if free) |
+ *     -------------------------------------------------------------
+ *
+ * f is set iff the block is free, p iff the previous block is free.
+ * Only free blocks carry the trailing copy of their size, which the
+ * next block uses to find its previous neighbour when coalescing.
+ * The heap ends with a zero-size allocated epilogue header.
+ *
+ * This package is not thread-safe; run mdriver -T against mm.c only.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mm.h"
+#include "memlib.h"
+
+team_t team = {
+    /* Team name */
+    "tlsf",
+    /* First member's full name */
+    "Harry Bovik",
+    /* First member's email address */
+    "bovik@cs.cmu.edu",
+    /* Second member's full name (leave blank if none) */
+    "",
+    /* Second member's email address (leave blank if none) */
+    ""
+};
+
+/* Basic constants */
+#define WSIZE      sizeof(size_t)      /* header size (bytes) */
+#define ALIGNMENT  16                  /* payload alignment (bytes) */
+#define MINBLOCK   ALIGN(4*WSIZE)      /* header, two links and footer */
+#define CHUNKSIZE  (1<<12)             /* min amount to extend heap by */
+
+/* Second-level lists per power of two, and the first-level range */
+#define SL_LOG2    4
+#define SL_COUNT   (1 << SL_LOG2)
+#define FL_SHIFT   (SL_LOG2 + 4)                 /* log2(ALIGNMENT*SL_COUNT) */
+#define SMALL_SIZE ((size_t)1 << FL_SHIFT)       /* below: all in fl 0 */
+#define FL_COUNT   (32 - FL_SHIFT + 1)           /* block sizes fit in 32 bits */
+
+#define FREE_BIT   0x1
+#define PFREE_BIT  0x2
+
+#define MAX(x, y)  ((x) > (y) ? (x) : (y))
+#define ALIGN(size) (((size) + (ALIGNMENT-1)) & ~(size_t)(ALIGNMENT-1))
+
+/* Block access, bp points at the payload */
+#define HDR(bp)         (*(size_t *)((char *)(bp) - WSIZE))
+#define SIZE(bp)        (HDR(bp) & ~(ALIGNMENT-1))
+#define IS_FREE(bp)     (HDR(bp) & FREE_BIT)
+#define PREV_FREE(bp)   (HDR(bp) & PFREE_BIT)
+#define NEXT_BLK(bp)    ((char *)(bp) + SIZE(bp))
+#define PREV_BLK(bp)    ((char *)(bp) - *(size_t *)((char *)(bp) - 2*WSIZE))
+#define NEXT_FREE(bp)   (((char **)(bp))[0])
+#define PREV_FREE_(bp)  (((char **)(bp))[1])
+
+/* Global variables */
+static unsigned int fl_bitmap;              /* non-empty first levels */
+static unsigned int sl_bitmap[FL_COUNT];    /* non-empty second levels */
+static char *blocks[FL_COUNT][SL_COUNT];    /* segregated free lists */
+
+/* function prototypes for internal helper routines */
+static void *extend_heap(size_t size);
+static void *block_merge(char *bp);
+static void block_split(char *bp, size_t asize);
+static void set_free(char *bp, size_t size);
+static void set_used(char *bp, size_t size);
+static size_t adjust_size(size_t size);
+
+/*
+ * fls - index of the most significant set bit
+ */
+static inline int fls(size_t x)
+{
+    return (int)(8*sizeof(unsigned long) - 1) - __builtin_clzl((unsigned long)x);
+}
+
+/*
+ * mapping_insert - The list (fl, sl) a block of size bytes belongs to
+ */
+static inline void mapping_insert(size_t size, int *fl, int *sl)
+{
+    int f;
+
+    if (size < SMALL_SIZE) {
+	*fl = 0;
+	*sl = size / (SMALL_SIZE / SL_COUNT);
+	return;
+    }
+    f = fls(size);
+    *sl = (int)(size >> (f - SL_LOG2)) ^ SL_COUNT;
+    *fl = f - (FL_SHIFT - 1);
+}
+
+/*
+ * mapping_search - Like mapping_insert, but rounds size up to the next
+ *     list boundary first, so that every block in the list found fits.
+ */
+static inline void mapping_search(size_t size, int *fl, int *sl)
+{
+    if (size >= SMALL_SIZE)
+	size += ((size_t)1 << (fls(size) - SL_LOG2)) - 1;
+    mapping_insert(size, fl, sl);
+}
+
+/*
+ * find_suitable - Head of the first non-empty list at or above (fl, sl)
+ */
+static char *find_suitable(int *fl, int *sl)
+{
+    unsigned int sl_map, fl_map;
+
+    if (*fl >= FL_COUNT)
+	return NULL;
+    sl_map = sl_bitmap[*fl] & (~0u << *sl);
+    if (!sl_map) {
+	fl_map = (*fl + 1 < 32) ? fl_bitmap & (~0u << (*fl + 1)) : 0;
+	if (!fl_map)
+	    return NULL;
+	*fl = __builtin_ctz(fl_map);
+	sl_map = sl_bitmap[*fl];
+    }
+    *sl = __builtin_ctz(sl_map);
+    return blocks[*fl][*sl];
+}
+
+/*
+ * insert_block - Push a free block on the head of its list
+ */
+static void insert_block(char *bp)
+{
+    int fl, sl;
+
+    mapping_insert(SIZE(bp), &fl, &sl);
+    NEXT_FREE(bp) = blocks[fl][sl];
+    PREV_FREE_(bp) = NULL;
+    if (blocks[fl][sl])
+	PREV_FREE_(blocks[fl][sl]) = bp;
+    blocks[fl][sl] = bp;
+    fl_bitmap |= 1u << fl;
+    sl_bitmap[fl] |= 1u << sl;
+}
+
+/*
+ * remove_block - Unlink a free block from its list
+ */
+static void remove_block(char *bp)
+{
+    char *next = NEXT_FREE(bp), *prev = PREV_FREE_(bp);
+    int fl, sl;
+
+    mapping_insert(SIZE(bp), &fl, &sl);
+    if (next)
+	PREV_FREE_(next) = prev;
+    if (prev)
+	NEXT_FREE(prev) = next;
+    else if ((blocks[fl][sl] = next) == NULL) {
+	sl_bitmap[fl] &= ~(1u << sl);
+	if (!sl_bitmap[fl])
+	    fl_bitmap &= ~(1u << fl);
+    }
+}
+
+/*
+ * mm_init - Initialize the memory manager
+ */
+int mm_init(void)
+{
+    char *p;
+
+    fl_bitmap = 0;
+    memset(sl_bitmap, 0, sizeof(sl_bitmap));
+    memset(blocks, 0, sizeof(blocks));
+
+    /* alignment padding, then the epilogue header */
+    if ((p = mem_sbrk(ALIGNMENT)) == (void *)-1)
+	return -1;
+    *(size_t *)(p + ALIGNMENT - WSIZE) = 0;    /* epilogue: size 0, used */
+
+    if (extend_heap(CHUNKSIZE) == NULL)
+	return -1;
+    return 0;
+}
+
+/*
+ * mm_malloc - Allocate a block with at least size bytes of payload
+ */
+void *mm_malloc(size_t size)
+{
+    size_t asize;
+    char *bp;
+    int fl, sl;
+
+    if (size == 0)
+	return NULL;
+    asize = adjust_size(size);
+
+    mapping_search(asize, &fl, &sl);
+    if ((bp = find_suitable(&fl, &sl)) != NULL)
+	remove_block(bp);
+    else if ((bp = extend_heap(MAX(asize, CHUNKSIZE))) != NULL)
+	remove_block(bp);
+    else
+	return NULL;
+
+    block_split(bp, asize);
+    return bp;
+}
+
+/*
+ * mm_free - Free a block
+ */
+void mm_free(void *ptr)
+{
+    char *bp = ptr;
+
+    if (bp == NULL)
+	return;
+    set_free(bp, SIZE(bp));
+    insert_block(block_merge(bp));
+}
+
+/*
+ * mm_realloc - Resize in place when the block or its free successor is
+ *     big enough, otherwise move the payload to a new block
+ */
+void *mm_realloc(void *ptr, size_t size)
+{
+    char *bp = ptr, *next, *newp;
+    size_t asize, csize;
+
+    if (ptr == NULL)
+	return mm_malloc(size);
+    if (size == 0) {
+	mm_free(ptr);
+	return NULL;
+    }
+    asize = adjust_size(size);
+    csize = SIZE(bp);
+    next = NEXT_BLK(bp);
+
+    if (csize < asize && IS_FREE(next) && csize + SIZE(next) >= asize) {
+	remove_block(next);
+	csize += SIZE(next);
+	set_used(bp, csize);
+    }
+    if (csize >= asize) {
+	block_split(bp, asize);
+	return bp;
+    }
+
+    if ((newp = mm_malloc(size)) == NULL)
+	return NULL;
+    memcpy(newp, bp, csize - WSIZE);
+    mm_free(bp);
+    return newp;
+}
+
+/*
+ * mm_malloc_batch - Allocate n blocks of size bytes, one at a time
+ */
+int mm_malloc_batch(size_t size, int n, void **out)
+{
+    int i;
+
+    for (i = 0; i < n; i++)
+	if ((out[i] = mm_malloc(size)) == NULL)
+	    break;
+    return i;
+}
+
+/*
+ * mm_free_batch - Free n blocks, one at a time
+ */
+void mm_free_batch(void **ptrs, int n)
+{
+    int i;
+
+    for (i = 0; i < n; i++)
+	mm_free(ptrs[i]);
+}
+
+/* The remaining routines are internal helper routines */
+
+/*
+ * adjust_size - Block size needed for a request of size payload bytes
+ */
+static size_t adjust_size(size_t size)
+{
+    size_t asize = ALIGN(size + WSIZE);
+    return MAX(asize, MINBLOCK);
+}
+
+/*
+ * set_free - Mark bp free with the given size and tell the next block
+ */
+static void set_free(char *bp, size_t size)
+{
+    HDR(bp) = size | (HDR(bp) & PFREE_BIT) | FREE_BIT;
+    *(size_t *)(bp + size - 2*WSIZE) = size;   /* footer */
+    HDR(bp + size) |= PFREE_BIT;
+}
+
+/*
+ * set_used - Mark bp allocated with the given size and tell the next block
+ */
+static void set_used(char *bp, size_t size)
+{
+    HDR(bp) = size | (HDR(bp) & PFREE_BIT);
+    HDR(bp + size) &= ~PFREE_BIT;
+}
+
+/*
+ * block_split - Make bp an allocated block of asize bytes, returning
+ *     any remainder big enough to be a block to the free lists
+ */
+static void block_split(char *bp, size_t asize)
+{
+    size_t csize = SIZE(bp);
+    char *rest;
+
+    if (csize - asize >= MINBLOCK) {
+	set_used(bp, asize);
+	rest = bp + asize;
+	HDR(rest) = 0;
+	set_free(rest, csize - asize);
+	insert_block(block_merge(rest));
+    }
+    else
+	set_used(bp, csize);
+}
+
+/*
+ * block_merge - Coalesce free block bp with its free neighbours, which
+ *     are removed from their lists. Returns the merged block.
+ */
+static void *block_merge(char *bp)
+{
+    size_t size = SIZE(bp);
+    char *next = NEXT_BLK(bp);
+
+    if (IS_FREE(next)) {
+	remove_block(next);
+	size += SIZE(next);
+    }
+    if (PREV_FREE(bp)) {
+	bp = PREV_BLK(bp);
+	remove_block(bp);
+	size += SIZE(bp);
+    }
+    set_free(bp, size);
+    return bp;
+}
+
+/*
+ * extend_heap - Grow the heap by size bytes. The old epilogue becomes
+ *     the header of the new free block, which is coalesced with a free
+ *     last block and inserted in the free lists.
+ */
+static void *extend_heap(size_t size)
+{
+    char *bp;
+
+    size = ALIGN(size);
+    if ((bp = mem_sbrk(size)) == (void *)-1)
+	return NULL;
+
+    HDR(bp) &= PFREE_BIT;           /* old epilogue, keep its p bit */
+    HDR(bp + size) = 0;             /* new epilogue */
+    set_free(bp, size);
+    bp = block_merge(bp);
+    insert_block(bp);
+    return bp;
+}
@@ -1,32 +1,50 @@
 /* 
- * mm-implicit.c -  Simple allocator based on implicit free lists, 
- *                  first fit placement, and boundary tag coalescing. 
+ * mm.c - Allocator based on segregated explicit free lists, placement
+ *        chosen by mm_set_policy (LIFO first fit by default), and
+ *        boundary tag coalescing.
  *
- * Each block has header and footer of the form:
+ * Each block has a header of the form:
  * 
  *      31                     3  2  1  0 
  *      -----------------------------------
- *     | s  s  s  s  ... s  s  s  0  0  a/f
+ *     | s  s  s  s  ... s  s  s  g  p  a/f
  *      ----------------------------------- 
  * 
- * where s are the meaningful size bits and a/f is set 
- * iff the block is allocated. The list has the following form:
+ * where s are the meaningful size bits, a/f is set iff the block is
+ * allocated and p is set iff the previous block is allocated. g marks
+ * an allocated block that mm_realloc has grown before. Only
+ * free blocks repeat the size in a footer (and hold the pred/succ
+ * links of their Separate_lists list); allocated blocks are header
+ * plus payload. The list has the following form:
  *
  * begin                                                          end
  * heap                                                           heap  
  *  -----------------------------------------------------------------   
- * |  pad   | hdr(8:a) | ftr(8:a) | zero or more usr blks | hdr(8:a) |
+ * |  pad   | hdr(16:a)| ftr(16:a)| zero or more usr blks | hdr(0:a) |
  *  -----------------------------------------------------------------
  *          |       prologue      |                       | epilogue |
  *          |         block       |                       | block    |
  *
  * The allocated prologue and epilogue blocks are overhead that
- * eliminate edge conditions during coalescing.
+ * eliminate edge conditions during coalescing. Headers, footers and
+ * list links are 32-bit words on every machine, and payloads are
+ * ALIGNMENT (16) byte aligned, so the heap is limited to 4 GB.
+ *
+ * Requests of up to SLAB_MAX bytes do not get blocks of their own but
+ * header-less objects carved from page-sized slab runs (see slab below).
+ * Free blocks of RB_MIN bytes or more are kept in a red-black tree by
+ * size rather than on the lists (see rbtree below).
+ *
+ * The package is thread-safe. Every thread owns a small cache of
+ * recently freed blocks (see tcache below) that serves most small
+ * requests without locking; everything else goes through heap_lock.
  */
 #include <stdio.h>
 #include <unistd.h>
 #include <string.h>
 #include <stdlib.h>
+#include <stdint.h>
+#include <pthread.h>
 #include "mm.h"
 #include "memlib.h"
 
@@ -47,132 +65,1254 @@ team_t team = {
 
 /* $begin mallocmacros */
 /* Basic constants and macros */
-#define WSIZE       4       /* word size (bytes) */  
+#define WSIZE       4       /* word size: header, footer, list link (bytes) */  
 #define DSIZE       8       /* doubleword size (bytes) */
-#define CHUNKSIZE  (1<<12)  /* initial heap size (bytes) */
-#define OVERHEAD    8    /* overhead of header, footer and succ pointer(bytes) 4 bytes for alignment*/
+#define OVERHEAD    WSIZE   /* overhead of an allocated block: its header */
+#define MINBLOCK   (2*DSIZE) /* header, pred, succ and footer of a free block */
+#define HEAP_LIMIT (1UL<<32) /* offsets and sizes are 32 bits: at most 4 GB */
+#define MAX_REQUEST (SIZE_MAX/4) /* larger requests fail before any size
+                                    arithmetic could wrap */
+
+/* Payload alignment and block size unit, a power of two of at least 16
+   bytes, and the initial heap size. Like SL_BITS and MM_POLICY, they
+   can be overridden with -D to build variants (see VARIANTS in the
+   Makefile). */
+#ifndef ALIGNMENT
+#define ALIGNMENT   16
+#endif
+#ifndef CHUNKSIZE
+#define CHUNKSIZE  (1<<12)
+#endif
+
+/* A free block this big at the top of the heap is given back to memlib,
+   all but CHUNKSIZE bytes of it, until huge blocks raise the threshold
+   (see mmap below). Override with -DTRIM_THRESHOLD=... */
+#ifndef TRIM_THRESHOLD
+#define TRIM_THRESHOLD (1<<16)
+#endif
 
 #define MAX(x, y) ((x) > (y)? (x) : (y))  
+#define MIN(x, y) ((x) < (y)? (x) : (y))
+
+/* Round up to a multiple of ALIGNMENT */
+#define ALIGN(size)  (((size) + (ALIGNMENT-1)) & ~(size_t)(ALIGNMENT-1))
 
 /* Pack a size and allocated bit into a word */
 #define PACK(size, alloc)  ((size) | (alloc))
 
 /* Read and write a word at address p */
-#define GET(p)       (*(size_t *)(p))
-#define PUT(p, val)  (*(size_t *)(p) = (val))  
+#define GET(p)       (*(unsigned int *)(p))
+#define PUT(p, val)  (*(unsigned int *)(p) = (unsigned int)(val))  
 
 /* Read the size and allocated fields from address p */
 #define GET_SIZE(p)  (GET(p) & ~0x7)
 #define GET_ALLOC(p) (GET(p) & 0x1)
 
-/* Given block ptr bp, compute address of its header and footer */
+/* Read, set and clear the previous-block-allocated bit of header p */
+#define PREV_ALLOC          0x2
+#define GET_PREV_ALLOC(p)   (GET(p) & PREV_ALLOC)
+#define SET_PREV_ALLOC(p)   PUT(p, GET(p) | PREV_ALLOC)
+#define CLR_PREV_ALLOC(p)   PUT(p, GET(p) & ~PREV_ALLOC)
+
+/* Growth tag of an allocated block, set when realloc grows it */
+#define GROWN               0x4
+#define GET_GROWN(p)        (GET(p) & GROWN)
+
+/* Given block ptr bp, compute address of its header and (if free) footer */
 #define HDRP(bp)       ((char *)(bp) - WSIZE)  
 #define FTRP(bp)       ((char *)(bp) + GET_SIZE(HDRP(bp)) - DSIZE)
 
-/* Given block ptr bp, compute address of next and previous blocks */
+/* Given block ptr bp, compute address of next and (if free) previous blocks */
 #define NEXT_BLKP(bp)  ((char *)(bp) + GET_SIZE(((char *)(bp) - WSIZE)))
 #define PREV_BLKP(bp)  ((char *)(bp) - GET_SIZE(((char *)(bp) - DSIZE)))
 
-#define PRED(bp)  bp
-#define SUCC(bp)  ((char *)(bp)+WSIZE)
+/*
+ * Free-list links are 32-bit offsets from the start of the heap (0 is
+ * NULL: offset 0 is alignment padding, never a block), which keeps
+ * MINBLOCK at 16 bytes on 64-bit machines.
+ */
+#define TO_OFF(p)    ((p) ? (unsigned int)((char *)(p) - heap_base) : 0)
+#define TO_PTR(off)  ((off) ? heap_base + (off) : NULL)
+
+#define PRED(bp)  bp
+#define SUCC(bp)  ((char *)(bp)+WSIZE)
+
+#define GET_PRED(bp) TO_PTR(GET(PRED(bp)))
+#define GET_SUCC(bp) TO_PTR(GET(SUCC(bp)))
+#define PUT_PRED(bp, p) PUT(PRED(bp), TO_OFF(p))
+#define PUT_SUCC(bp, p) PUT(SUCC(bp), TO_OFF(p))
+/* $end mallocmacros */
+
+/* Global variables */
+static char *heap_listp;  /* pointer to first block */  
+static char *heap_base;   /* mem_heap_lo(), the base of link offsets */
+/*
+ * Separate lists: each power of two [2^k, 2^(k+1)) is cut into
+ * 2^SL_BITS equal sub-classes, e.g. {64..79}, {80..95}, {96..111},
+ * {112..127}, {128..159}, ... A bit in List_map is set iff the
+ * corresponding list is non-empty.
+ */
+#ifndef SL_BITS
+#define SL_BITS    2                       /* log2 of sub-classes per power of two */
+#endif
+#define NumofLists (32<<SL_BITS)           /* block sizes fit in 32 bits */
+#define MAPWORDS   (NumofLists/32)         /* words in List_map */
+
+/* function prototypes for internal helper routines */
+static void *extend_heap(size_t words);
+static void place(void *bp, size_t asize);
+static void *find_fit(size_t asize);
+static void *list_fit(size_t asize);
+static void *coalesce(void *bp);
+static void printblock(void *bp);
+static void checkblock(void *bp);
+static size_t adjust_size(size_t size);
+static void *malloc_block(size_t asize);
+static void *malloc_aligned(size_t asize, size_t align);
+static void free_block(void *bp);
+static void *realloc_block(void *bp, size_t asize);
+static void shrink_block(void *bp, size_t asize);
+static void trim_heap(void *bp);
+static void *heap_malloc(size_t size);
+static void heap_free(void *bp);
+static size_t usable_size(void *bp);
+
+static char* Separate_lists[NumofLists]={NULL,};  //separate lists for free blocks.
+static unsigned int List_map[MAPWORDS];    //non-empty bitmap of Separate_lists
+
+/* heap_lock guards the heap, Separate_lists and mem_sbrk */
+static pthread_mutex_t heap_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t fork_once = PTHREAD_ONCE_INIT;
+
+/*
+ * fork_lock, fork_unlock - Hold heap_lock across fork, so that a child
+ *     never inherits it locked by a thread that it does not have
+ */
+static void fork_lock(void)
+{
+    pthread_mutex_lock(&heap_lock);
+}
+
+static void fork_unlock(void)
+{
+    pthread_mutex_unlock(&heap_lock);
+}
+
+static void fork_init(void)
+{
+    pthread_atfork(fork_lock, fork_unlock, fork_unlock);
+}
+
+/* $begin tcache */
+/*
+ * Per-thread caches. A small block freed by a thread stays marked
+ * allocated and is pushed on that thread's bin for its payload class,
+ * from where the next mm_malloc of the class pops it without taking
+ * heap_lock. Empty bins are refilled, and full bins drained, from the
+ * shared Separate_lists TCACHE_BATCH blocks at a time.
+ *
+ * Bin i holds blocks with at least i*ALIGNMENT bytes of payload. Blocks
+ * are linked through the first payload word.
+ */
+#define TCACHE_BINS   64  /* bins for payloads below TCACHE_BINS*ALIGNMENT bytes */
+#define TCACHE_COUNT   8  /* max blocks held in one bin */
+#define TCACHE_BATCH   4  /* blocks moved per refill or drain */
+
+#define TC_MAX           ((TCACHE_BINS-1) * ALIGNMENT)         /* largest cached request */
+#define TC_INDEX(size)   (((size) + ALIGNMENT-1) / ALIGNMENT)  /* bin serving a request */
+#define TC_CLASS(usable) ((usable) / ALIGNMENT)               /* bin of a block */
+#define TC_NEXT(bp)      (*(char **)(bp))
+
+typedef struct {
+    unsigned epoch;                  /* heap_epoch the bins belong to */
+    int registered;                  /* destructor installed for thread? */
+    unsigned char count[TCACHE_BINS];
+    char *bins[TCACHE_BINS];
+} tcache_t;
+
+static __thread tcache_t tcache;
+static volatile unsigned heap_epoch;  /* bumped by each mm_init */
+static pthread_key_t tcache_key;
+static pthread_once_t tcache_once = PTHREAD_ONCE_INIT;
+
+/*
+ * tcache_drain - Give n blocks of bin idx back to the shared lists
+ */
+static void tcache_drain(tcache_t *tc, int idx, int n)
+{
+    char *bp;
+
+    pthread_mutex_lock(&heap_lock);
+    while (n-- > 0 && (bp = tc->bins[idx]) != NULL) {
+	tc->bins[idx] = TC_NEXT(bp);
+	tc->count[idx]--;
+	heap_free(bp);
+    }
+    pthread_mutex_unlock(&heap_lock);
+}
+
+/*
+ * tcache_release - Thread exit destructor, flushes the whole cache
+ */
+static void tcache_release(void *arg)
+{
+    tcache_t *tc = arg;
+    int i;
+
+    if (tc->epoch != heap_epoch)
+	return;
+    for (i = 0; i < TCACHE_BINS; i++)
+	tcache_drain(tc, i, TCACHE_COUNT);
+}
+
+static void tcache_key_init(void)
+{
+    pthread_key_create(&tcache_key, tcache_release);
+}
+
+/*
+ * tcache_get - Return the calling thread's cache. Blocks cached
+ *     before the last mm_init belong to a heap that no longer exists,
+ *     so they are simply dropped.
+ */
+static tcache_t *tcache_get(void)
+{
+    tcache_t *tc = &tcache;
+
+    if (tc->epoch != heap_epoch) {
+	memset(tc->count, 0, sizeof(tc->count));
+	memset(tc->bins, 0, sizeof(tc->bins));
+	tc->epoch = heap_epoch;
+	if (!tc->registered) {
+	    pthread_once(&tcache_once, tcache_key_init);
+	    pthread_setspecific(tcache_key, tc);
+	    tc->registered = 1;
+	}
+    }
+    return tc;
+}
+
+/*
+ * tcache_refill - Allocate TCACHE_BATCH blocks for bin idx, big enough
+ *     for the largest request the bin serves
+ */
+static void tcache_refill(tcache_t *tc, int idx)
+{
+    char *bp;
+    int i;
+
+    pthread_mutex_lock(&heap_lock);
+    for (i = 0; i < TCACHE_BATCH; i++) {
+	if ((bp = heap_malloc(idx * ALIGNMENT)) == NULL)
+	    break;
+	TC_NEXT(bp) = tc->bins[idx];
+	tc->bins[idx] = bp;
+	tc->count[idx]++;
+    }
+    pthread_mutex_unlock(&heap_lock);
+}
+/* $end tcache */
+
+/* $begin slab */
+/*
+ * Slab runs. Objects of up to SLAB_MAX bytes are packed, without any
+ * per-object header, into runs of one size class. A run is one
+ * allocated heap block of exactly SLAB_RUN bytes whose payload starts
+ * at a SLAB_RUN-aligned heap offset, so runs can tile the heap: a
+ * slab_run_t header followed by the objects. A bit per heap page in
+ * Slab_pages tells whether that page is a run, so mm_free finds the
+ * run of an object by masking its address. Runs with free objects
+ * are on their class's partial list. An empty run goes back to the
+ * heap unless it is the last partial run of its class.
+ */
+#define SLAB_MAX      128          /* largest request served from slabs */
+#define SLAB_CLASSES  (SLAB_MAX/ALIGNMENT)
+#define SLAB_RUN      4096         /* bytes in a run, a power of two */
+#define SLAB_MAPLEN   ((SLAB_RUN/ALIGNMENT + 31) / 32)
+#define SLAB_PAGEWORDS ((1UL<<32) / SLAB_RUN / 32)  /* 4 GB of heap pages */
+
+typedef struct {
+    unsigned short size;             /* object size of the run's class */
+    unsigned short nobjs;            /* objects in the run */
+    unsigned short nfree;            /* free objects in the run */
+    unsigned short hint;             /* no free objects in map[0..hint-1] */
+    unsigned int next, prev;         /* partial list links, as offsets */
+    unsigned int map[SLAB_MAPLEN];   /* bit set iff object is free */
+} slab_run_t;
+
+#define SLAB_HDR      ALIGN(sizeof(slab_run_t))  /* offset of first object */
+
+/* Page of bp and whether that page is a run, given bp is in the heap */
+#define SLAB_PAGE(bp) ((unsigned int)((char *)(bp) - heap_base) / SLAB_RUN)
+#define IS_SLAB(bp)   (Slab_pages[SLAB_PAGE(bp) >> 5] & (1u << (SLAB_PAGE(bp) & 31)))
+#define SLAB_OF(bp)   ((slab_run_t *)(heap_base + \
+		       (((char *)(bp) - heap_base) & ~(size_t)(SLAB_RUN-1))))
+
+static unsigned int Slab_pages[SLAB_PAGEWORDS];
+static unsigned int slab_pages_hi;         /* Slab_pages words ever used */
+static slab_run_t *Slab_partial[SLAB_CLASSES];
+
+/*
+ * slab_link/slab_unlink - Add or remove run on its class's partial list
+ */
+static void slab_link(slab_run_t *run)
+{
+    slab_run_t **head = &Slab_partial[run->size/ALIGNMENT - 1];
+
+    run->prev = 0;
+    run->next = TO_OFF(*head);
+    if (*head)
+	(*head)->prev = TO_OFF(run);
+    *head = run;
+}
+
+static void slab_unlink(slab_run_t *run)
+{
+    slab_run_t *next = (slab_run_t *)TO_PTR(run->next);
+    slab_run_t *prev = (slab_run_t *)TO_PTR(run->prev);
+
+    if (next)
+	next->prev = run->prev;
+    if (prev)
+	prev->next = run->next;
+    else
+	Slab_partial[run->size/ALIGNMENT - 1] = next;
+}
+
+/*
+ * slab_new - Carve a fresh run for objects of size bytes
+ */
+static slab_run_t *slab_new(size_t size)
+{
+    slab_run_t *run;
+    unsigned int page, i;
+
+    if ((run = malloc_aligned(SLAB_RUN, SLAB_RUN)) == NULL)
+	return NULL;
+    page = SLAB_PAGE(run);
+    Slab_pages[page >> 5] |= 1u << (page & 31);
+    if ((page >> 5) >= slab_pages_hi)
+	slab_pages_hi = (page >> 5) + 1;
+
+    run->size = size;
+    run->nobjs = run->nfree = (SLAB_RUN - OVERHEAD - SLAB_HDR) / size;
+    run->hint = 0;
+    memset(run->map, 0, sizeof(run->map));
+    for (i = 0; i < run->nobjs / 32; i++)
+	run->map[i] = ~0u;
+    if (run->nobjs % 32)
+	run->map[i] = (1u << (run->nobjs % 32)) - 1;
+    slab_link(run);
+    return run;
+}
+
+/*
+ * slab_malloc - Allocate an object for a request of 1 to SLAB_MAX bytes
+ */
+static void *slab_malloc(size_t size)
+{
+    int cls;
+    slab_run_t *run;
+    unsigned int w, bit;
+
+    if (size == 0)
+	return NULL;
+    cls = (size + ALIGNMENT-1) / ALIGNMENT - 1;
+    run = Slab_partial[cls];
+    if (run == NULL && (run = slab_new((cls+1) * ALIGNMENT)) == NULL)
+	return NULL;
+
+    for (w = run->hint; !run->map[w]; w++)
+	;
+    bit = __builtin_ctz(run->map[w]);
+    run->map[w] &= ~(1u << bit);
+    run->hint = w;
+    if (--run->nfree == 0)
+	slab_unlink(run);
+    return (char *)run + SLAB_HDR + (w*32 + bit) * run->size;
+}
+
+/*
+ * slab_free - Free an object, giving its run back to the heap when it
+ *     becomes empty and other runs of the class still have room
+ */
+static void slab_free(void *bp)
+{
+    slab_run_t *run = SLAB_OF(bp);
+    unsigned int i = ((char *)bp - (char *)run - SLAB_HDR) / run->size;
+    unsigned int page;
+
+    run->map[i >> 5] |= 1u << (i & 31);
+    if ((i >> 5) < run->hint)
+	run->hint = i >> 5;
+    if (run->nfree++ == 0)
+	slab_link(run);
+    if (run->nfree == run->nobjs && 
+	(run->next || run->prev)) {
+	slab_unlink(run);
+	page = SLAB_PAGE(run);
+	Slab_pages[page >> 5] &= ~(1u << (page & 31));
+	free_block(run);
+    }
+}
+/* $end slab */
+
+/* $begin mmap */
+/*
+ * Huge blocks. Requests of mmap_threshold bytes or more are not served
+ * from the heap at all but get a mapping of their own from mem_mmap,
+ * which is unmapped as soon as the block is freed and resized with
+ * mem_mremap, never copied. A mapping starts with an mmap_chunk_t that
+ * keeps it on the Mmap_chunks list, followed by the payload. Pointers
+ * outside the heap are huge blocks; no header word is needed.
+ *
+ * As in glibc, the threshold is dynamic: freeing a huge block raises
+ * mmap_threshold to its size (up to MMAP_THRESHOLD_MAX), and the trim
+ * threshold to at least twice that, so a program that keeps allocating blocks
+ * of one large size soon gets them from the heap without a round trip
+ * to the kernel each time.
+ */
+#ifndef MMAP_THRESHOLD
+#define MMAP_THRESHOLD (1<<17)
+#endif
+#define MMAP_THRESHOLD_MAX (1<<25)
+
+static size_t mmap_threshold;  /* smallest request mapped */
+static size_t trim_threshold;  /* smallest free top block trimmed */
+
+typedef struct mmap_chunk {
+    size_t len;                      /* bytes mapped */
+    struct mmap_chunk *next, *prev;  /* Mmap_chunks links */
+} mmap_chunk_t;
+
+#define MMAP_HDR      ALIGN(sizeof(mmap_chunk_t))  /* offset of the payload */
+#define IN_HEAP(bp)   ((size_t)((char *)(bp) - heap_base) < mem_heapsize())
+#define CHUNK_OF(bp)  ((mmap_chunk_t *)((char *)(bp) - MMAP_HDR))
+#define MMAP_LEN(size) (((size) + MMAP_HDR + mem_pagesize()-1) & ~(mem_pagesize()-1))
+
+static mmap_chunk_t *Mmap_chunks;  /* all huge blocks */
+
+/*
+ * chunk_link - Push a mapping on Mmap_chunks
+ */
+static void chunk_link(mmap_chunk_t *c)
+{
+    c->prev = NULL;
+    if ((c->next = Mmap_chunks) != NULL)
+	c->next->prev = c;
+    Mmap_chunks = c;
+}
+
+/*
+ * chunk_unlink - Take a mapping off Mmap_chunks
+ */
+static void chunk_unlink(mmap_chunk_t *c)
+{
+    if (c->next)
+	c->next->prev = c->prev;
+    if (c->prev)
+	c->prev->next = c->next;
+    else
+	Mmap_chunks = c->next;
+}
+
+/*
+ * mmap_malloc - Map a huge block for a request of size bytes
+ */
+static void *mmap_malloc(size_t size)
+{
+    size_t len = MMAP_LEN(size);
+    mmap_chunk_t *c;
+
+    if ((c = mem_mmap(len)) == (void *)-1)
+	return NULL;
+    c->len = len;
+    chunk_link(c);
+    return (char *)c + MMAP_HDR;
+}
+
+/*
+ * mmap_free - Unmap a huge block
+ */
+static void mmap_free(void *bp)
+{
+    mmap_chunk_t *c = CHUNK_OF(bp);
+
+    chunk_unlink(c);
+    if (c->len - MMAP_HDR > mmap_threshold && c->len <= MMAP_THRESHOLD_MAX) {
+	mmap_threshold = c->len - MMAP_HDR;
+	trim_threshold = MAX(trim_threshold, 2 * mmap_threshold);
+    }
+    mem_munmap(c);
+}
+
+/*
+ * mmap_realloc - Resize a huge block to size bytes with mem_mremap,
+ *     which moves the pages rather than the bytes if it has to
+ */
+static void *mmap_realloc(void *bp, size_t size)
+{
+    size_t len = MMAP_LEN(size);
+    mmap_chunk_t *c = CHUNK_OF(bp), *nc;
+
+    if (len == c->len)
+	return bp;
+    chunk_unlink(c);
+    if ((nc = mem_mremap(c, len)) == (void *)-1) {
+	chunk_link(c);
+	return NULL;
+    }
+    nc->len = len;
+    chunk_link(nc);
+    return (char *)nc + MMAP_HDR;
+}
+/* $end mmap */
+
+/* $begin quick */
+/*
+ * Quick lists. A block of at most QUICK_MAX bytes freed by heap_free is
+ * not coalesced at once: it stays marked allocated, with no header or
+ * footer update and no list removals for its neighbours, and is pushed
+ * on the quick list of its exact size. malloc_block pops the list of
+ * the size it needs before it searches Separate_lists, so free-then-
+ * malloc churn costs a push and a pop. All quick blocks are freed and
+ * coalesced in one sweep when a fit fails, when a request too big for
+ * them comes in (as dlmalloc consolidates its fastbins), or when they
+ * hold more than 1/QUICK_SHARE of the heap, so that deferring costs
+ * neither heap growth nor fragmentation.
+ *
+ * Quick lists are linked through the PRED word, as heap offsets.
+ * They are off by default (QUICK_MAX 0: every block is coalesced at
+ * once): behind the thread caches they gave no measurable throughput
+ * gain, even on binary-bal and binary2-bal. Compile with e.g.
+ * -DQUICK_MAX=1024 to try them.
+ */
+#ifndef QUICK_MAX
+#define QUICK_MAX     0     /* largest block held (bytes) */
+#endif
+#define QUICK_SHARE   8     /* flush at 1/QUICK_SHARE of the heap */
+#define QUICK_LISTS   (QUICK_MAX/ALIGNMENT + 1)
+
+#define QK_NEXT(bp)   TO_PTR(GET(PRED(bp)))
+
+static char *Quick_lists[QUICK_LISTS];  /* quick list of each block size */
+static size_t quick_bytes;              /* bytes held in all of them */
+
+/*
+ * quick_flush - Free and coalesce every quick block. Caller holds
+ *     heap_lock.
+ */
+static void quick_flush(void)
+{
+    char *bp;
+    int i;
+
+    for (i = 0; i < QUICK_LISTS && quick_bytes > 0; i++)
+	while ((bp = Quick_lists[i]) != NULL) {
+	    Quick_lists[i] = QK_NEXT(bp);
+	    quick_bytes -= GET_SIZE(HDRP(bp));
+	    free_block(bp);
+	}
+}
+
+/*
+ * quick_free - Hold block bp on its quick list, flushing them all once
+ *     they get too big a share of the heap. Caller holds heap_lock.
+ */
+static void quick_free(void *bp)
+{
+    size_t size = GET_SIZE(HDRP(bp));
+
+    PUT(PRED(bp), TO_OFF(Quick_lists[size / ALIGNMENT]));
+    Quick_lists[size / ALIGNMENT] = bp;
+    if ((quick_bytes += size) > mem_heapsize() / QUICK_SHARE)
+	quick_flush();
+}
+
+/*
+ * quick_malloc - Pop a block of exactly asize bytes, or NULL. Caller
+ *     holds heap_lock.
+ */
+static void *quick_malloc(size_t asize)
+{
+    char *bp;
+
+    if (asize > QUICK_MAX || (bp = Quick_lists[asize / ALIGNMENT]) == NULL)
+	return NULL;
+    Quick_lists[asize / ALIGNMENT] = QK_NEXT(bp);
+    quick_bytes -= asize;
+    PUT(HDRP(bp), GET(HDRP(bp)) & ~GROWN);  /* a new block */
+    return bp;
+}
+/* $end quick */
+
+/*
+ * List_Index - Separate list holding blocks of the given size, found
+ *     with one count-leading-zeros instead of a shift loop
+ */
+static inline int List_Index(size_t size)
+{
+    int fl = 31 - __builtin_clz((unsigned int)size);   /* floor(log2(size)) */
+
+    if (fl < SL_BITS)
+        return fl << SL_BITS;
+    return (fl << SL_BITS) | ((size >> (fl - SL_BITS)) & ((1 << SL_BITS) - 1));
+}
+
+/*
+ * Snap_Index - mm_snapshot class of the given size: four per power of
+ *     two, whatever SL_BITS is
+ */
+static inline int Snap_Index(size_t size)
+{
+    int fl = 31 - __builtin_clz((unsigned int)size);
+
+    return (fl << 2) | ((size >> (fl - 2)) & 3);
+}
+
+/*
+ * Next_List - First non-empty list with an index above index, or -1
+ */
+static inline int Next_List(int index)
+{
+    int w = ++index >> 5;
+    unsigned int bits;
+
+    if (index >= NumofLists)
+        return -1;
+    bits = List_map[w] & (~0u << (index & 31));
+    while (!bits) {
+        if (++w >= MAPWORDS)
+            return -1;
+        bits = List_map[w];
+    }
+    return (w << 5) + __builtin_ctz(bits);
+}
+
+/* $begin policy */
+/*
+ * Placement policies (see mm_set_policy in mm.h). They differ in how
+ * the blocks of one list are kept and which of them find_fit picks:
+ *
+ *   MM_LIFO     freed blocks are pushed on the front of their list;
+ *               the first that fits is taken
+ *   MM_ADDRESS  each list is a treap keyed on the block address, so
+ *               the lowest-addressed block that fits is taken, and
+ *               insertion and deletion take O(log n)
+ *   MM_BESTFIT  LIFO lists; the smallest of the first policy_k blocks
+ *               that fit is taken
+ *   MM_NEXTFIT  LIFO lists; each list's search starts where its last
+ *               one stopped, at its Rovers entry
+ *
+ * A treap node needs only the two link words a free block already has
+ * (left and right children in place of pred and succ), because its
+ * priority is a hash of its offset rather than a stored number. Treap
+ * roots are kept in Separate_lists like list heads. The policy only
+ * changes in mm_init, when every list is empty.
+ */
+#ifndef MM_POLICY
+#define MM_POLICY  MM_LIFO   /* policy until mm_set_policy picks another */
+#endif
+static int policy = MM_POLICY, next_policy = MM_POLICY;
+static int policy_k = 8, next_policy_k = 8;
+static char *Rovers[NumofLists];   /* next-fit start of each list */
+
+#define LEFT(bp)   ((unsigned int *)PRED(bp))
+#define RIGHT(bp)  ((unsigned int *)SUCC(bp))
+
+/* The treap priority of the block at offset off: a 32-bit mix */
+static inline unsigned int tree_prio(unsigned int off)
+{
+    off ^= off >> 16;
+    off *= 0x85ebca6b;
+    off ^= off >> 13;
+    off *= 0xc2b2ae35;
+    return off ^ (off >> 16);
+}
+
+/*
+ * tree_split - Split the treap t into the nodes below off, which go to
+ *     *l, and those above it, which go to *r
+ */
+static void tree_split(unsigned int t, unsigned int off, 
+		       unsigned int *l, unsigned int *r)
+{
+    while (t) {
+	if (t < off) {
+	    *l = t;
+	    l = RIGHT(TO_PTR(t));
+	    t = *l;
+	} else {
+	    *r = t;
+	    r = LEFT(TO_PTR(t));
+	    t = *r;
+	}
+    }
+    *l = *r = 0;
+}
+
+/*
+ * tree_merge - Join treaps l and r, every node of l being below every
+ *     node of r
+ */
+static unsigned int tree_merge(unsigned int l, unsigned int r)
+{
+    unsigned int root, *slot = &root;
+
+    while (l && r) {
+	if (tree_prio(l) > tree_prio(r)) {
+	    *slot = l;
+	    slot = RIGHT(TO_PTR(l));
+	    l = *slot;
+	} else {
+	    *slot = r;
+	    slot = LEFT(TO_PTR(r));
+	    r = *slot;
+	}
+    }
+    *slot = l ? l : r;
+    return root;
+}
+
+static void tree_insert(int index, char *bp)
+{
+    unsigned int off = TO_OFF(bp), p = tree_prio(off), root, t, *slot;
+
+    root = TO_OFF(Separate_lists[index]);
+    slot = &root;
+    while ((t = *slot) && tree_prio(t) > p)
+	slot = t < off ? RIGHT(TO_PTR(t)) : LEFT(TO_PTR(t));
+    tree_split(t, off, LEFT(bp), RIGHT(bp));
+    *slot = off;
+    Separate_lists[index] = TO_PTR(root);
+}
+
+static void tree_delete(int index, char *bp)
+{
+    unsigned int off = TO_OFF(bp), root, *slot;
+
+    root = TO_OFF(Separate_lists[index]);
+    for (slot = &root; *slot != off; )
+	slot = *slot < off ? RIGHT(TO_PTR(*slot)) : LEFT(TO_PTR(*slot));
+    *slot = tree_merge(*LEFT(bp), *RIGHT(bp));
+    Separate_lists[index] = TO_PTR(root);
+}
+
+/*
+ * tree_next - The lowest-addressed node of treap t above offset off,
+ *     or NULL
+ */
+static char *tree_next(unsigned int t, unsigned int off)
+{
+    unsigned int best = 0;
+
+    while (t) {
+	if (t > off) {
+	    best = t;
+	    t = *LEFT(TO_PTR(t));
+	} else
+	    t = *RIGHT(TO_PTR(t));
+    }
+    return TO_PTR(best);
+}
+
+/*
+ * List_First, List_Next - Walk the blocks of list index, in address
+ *     order under MM_ADDRESS
+ */
+static inline char *List_First(int index)
+{
+    if (policy == MM_ADDRESS)
+	return tree_next(TO_OFF(Separate_lists[index]), 0);
+    return Separate_lists[index];
+}
+
+static inline char *List_Next(int index, char *bp)
+{
+    if (policy == MM_ADDRESS)
+	return tree_next(TO_OFF(Separate_lists[index]), TO_OFF(bp));
+    return GET_SUCC(bp);
+}
+/* $end policy */
+
+/* $begin rbtree */
+/*
+ * Large free blocks. Blocks of RB_MIN bytes or more are not kept on
+ * Separate_lists but in one red-black tree ordered by size, and by
+ * address among blocks of one size, so find_fit takes the best fit
+ * for a large request (the lowest-addressed of the smallest blocks
+ * that fit) in O(log n), whatever the placement policy. Their List_map
+ * bits stay clear, so list searches never see them. The tree is kept
+ * to the top classes, tens of KB and up: below that, rebalancing on
+ * every insert and delete costs more throughput than best fit saves
+ * space.
+ *
+ * A node uses the first three words of its payload: its left and right
+ * children in place of pred and succ, then its parent, whose offset,
+ * being a multiple of ALIGNMENT, leaves the low bit free for the color.
+ */
+#ifndef RB_MIN
+#define RB_MIN      (1<<15)  /* smallest block in the tree (bytes) */
+#endif
+#define RB_RED      0x1
+
+#define RB_UP(bp)        ((char *)(bp) + DSIZE)  /* parent offset | color */
+#define RB_LEFT(bp)      GET_PRED(bp)
+#define RB_RIGHT(bp)     GET_SUCC(bp)
+#define RB_PARENT(bp)    TO_PTR(GET(RB_UP(bp)) & ~RB_RED)
+#define RB_IS_RED(bp)    ((bp) != NULL && (GET(RB_UP(bp)) & RB_RED))
+#define RB_SET_RED(bp)   PUT(RB_UP(bp), GET(RB_UP(bp)) | RB_RED)
+#define RB_SET_BLACK(bp) PUT(RB_UP(bp), GET(RB_UP(bp)) & ~RB_RED)
+#define RB_SET_PARENT(bp, p) \
+    PUT(RB_UP(bp), TO_OFF(p) | (GET(RB_UP(bp)) & RB_RED))
+
+/* Does block a come before block b in the tree? */
+#define RB_LESS(a, b) \
+    (GET_SIZE(HDRP(a)) < GET_SIZE(HDRP(b)) || \
+     (GET_SIZE(HDRP(a)) == GET_SIZE(HDRP(b)) && (a) < (b)))
+
+static char *Large_root;  /* root of the tree of large free blocks */
+static char *Large_min;   /* its first block, the best fit for any small request */
+
+/*
+ * rb_replace - Make new take old's place as a child of parent (or as
+ *     the root). Sets neither of their parent fields.
+ */
+static void rb_replace(char *parent, char *old, char *new)
+{
+    if (parent == NULL)
+	Large_root = new;
+    else if (RB_LEFT(parent) == old)
+	PUT_PRED(parent, new);
+    else
+	PUT_SUCC(parent, new);
+}
+
+/*
+ * rb_rotate_left, rb_rotate_right - Rotate the subtree at x, lifting
+ *     its right (left) child into its place
+ */
+static void rb_rotate_left(char *x)
+{
+    char *y = RB_RIGHT(x);
+
+    PUT_SUCC(x, RB_LEFT(y));
+    if (RB_LEFT(y) != NULL)
+	RB_SET_PARENT(RB_LEFT(y), x);
+    RB_SET_PARENT(y, RB_PARENT(x));
+    rb_replace(RB_PARENT(x), x, y);
+    PUT_PRED(y, x);
+    RB_SET_PARENT(x, y);
+}
+
+static void rb_rotate_right(char *x)
+{
+    char *y = RB_LEFT(x);
+
+    PUT_PRED(x, RB_RIGHT(y));
+    if (RB_RIGHT(y) != NULL)
+	RB_SET_PARENT(RB_RIGHT(y), x);
+    RB_SET_PARENT(y, RB_PARENT(x));
+    rb_replace(RB_PARENT(x), x, y);
+    PUT_SUCC(y, x);
+    RB_SET_PARENT(x, y);
+}
+
+/*
+ * rb_fit - The first block of the tree with at least asize bytes: the
+ *     best fit, or NULL
+ */
+static char *rb_fit(size_t asize)
+{
+    char *x = Large_root, *best = NULL;
+
+    while (x != NULL) {
+	if (GET_SIZE(HDRP(x)) >= asize) {
+	    best = x;
+	    x = RB_LEFT(x);
+	} else
+	    x = RB_RIGHT(x);
+    }
+    return best;
+}
+
+/*
+ * rb_next, rb_prev - The block after (before) bp in the tree, or NULL
+ */
+static char *rb_next(char *bp)
+{
+    char *p;
+
+    if (RB_RIGHT(bp) != NULL) {
+	for (bp = RB_RIGHT(bp); RB_LEFT(bp) != NULL; bp = RB_LEFT(bp))
+	    ;
+	return bp;
+    }
+    while ((p = RB_PARENT(bp)) != NULL && bp == RB_RIGHT(p))
+	bp = p;
+    return p;
+}
+
+static char *rb_prev(char *bp)
+{
+    char *p;
+
+    if (RB_LEFT(bp) != NULL) {
+	for (bp = RB_LEFT(bp); RB_RIGHT(bp) != NULL; bp = RB_RIGHT(bp))
+	    ;
+	return bp;
+    }
+    while ((p = RB_PARENT(bp)) != NULL && bp == RB_LEFT(p))
+	bp = p;
+    return p;
+}
+
+/*
+ * rb_insert - Add free block bp to the tree
+ */
+static void rb_insert(char *bp)
+{
+    char *p = NULL, *x = Large_root, *g, *u;
+
+    while (x != NULL) {
+	p = x;
+	x = RB_LESS(bp, x) ? RB_LEFT(x) : RB_RIGHT(x);
+    }
+    PUT_PRED(bp, NULL);
+    PUT_SUCC(bp, NULL);
+    PUT(RB_UP(bp), TO_OFF(p) | RB_RED);
+    if (Large_min == NULL || RB_LESS(bp, Large_min))
+	Large_min = bp;
+    if (p == NULL)
+	Large_root = bp;
+    else if (RB_LESS(bp, p))
+	PUT_PRED(p, bp);
+    else
+	PUT_SUCC(p, bp);
+
+    /* Restore the colors: no red node has a red child */
+    while (RB_IS_RED(p = RB_PARENT(bp))) {
+	g = RB_PARENT(p);
+	if (p == RB_LEFT(g)) {
+	    if (RB_IS_RED(u = RB_RIGHT(g))) {
+		RB_SET_BLACK(p);
+		RB_SET_BLACK(u);
+		RB_SET_RED(g);
+		bp = g;
+		continue;
+	    }
+	    if (bp == RB_RIGHT(p)) {
+		rb_rotate_left(p);
+		p = bp;
+	    }
+	    rb_rotate_right(g);
+	} else {
+	    if (RB_IS_RED(u = RB_LEFT(g))) {
+		RB_SET_BLACK(p);
+		RB_SET_BLACK(u);
+		RB_SET_RED(g);
+		bp = g;
+		continue;
+	    }
+	    if (bp == RB_LEFT(p)) {
+		rb_rotate_right(p);
+		p = bp;
+	    }
+	    rb_rotate_left(g);
+	}
+	RB_SET_BLACK(p);  /* p now heads the subtree: done */
+	RB_SET_RED(g);
+	break;
+    }
+    RB_SET_BLACK(Large_root);
+}
+
+/*
+ * rb_transplant - Put the subtree v (maybe empty) in the place of u
+ */
+static void rb_transplant(char *u, char *v)
+{
+    rb_replace(RB_PARENT(u), u, v);
+    if (v != NULL)
+	RB_SET_PARENT(v, RB_PARENT(u));
+}
+
+/*
+ * rb_delete - Remove free block bp from the tree
+ */
+static void rb_delete(char *bp)
+{
+    char *x, *xp, *y, *w;
+    int red = RB_IS_RED(bp);
+
+    if (bp == Large_min)
+	Large_min = rb_next(bp);
 
-#define GET_PRED(bp) GET(PRED(bp))
-#define GET_SUCC(bp) GET(SUCC(bp))
-/* $end mallocmacros */
+    /* Unlink bp, or its successor y if it has two children, leaving x
+       (maybe NULL) in the place of the unlinked node, under xp */
+    if (RB_LEFT(bp) == NULL || RB_RIGHT(bp) == NULL) {
+	if ((x = RB_LEFT(bp)) == NULL)
+	    x = RB_RIGHT(bp);
+	xp = RB_PARENT(bp);
+	rb_transplant(bp, x);
+    } else {
+	for (y = RB_RIGHT(bp); RB_LEFT(y) != NULL; y = RB_LEFT(y))
+	    ;
+	red = RB_IS_RED(y);
+	x = RB_RIGHT(y);
+	if (RB_PARENT(y) == bp)
+	    xp = y;
+	else {
+	    xp = RB_PARENT(y);
+	    rb_transplant(y, x);
+	    PUT_SUCC(y, RB_RIGHT(bp));
+	    RB_SET_PARENT(RB_RIGHT(y), y);
+	}
+	rb_transplant(bp, y);
+	PUT_PRED(y, RB_LEFT(bp));
+	RB_SET_PARENT(RB_LEFT(y), y);
+	if (RB_IS_RED(bp))
+	    RB_SET_RED(y);
+	else
+	    RB_SET_BLACK(y);
+    }
+    if (red)
+	return;
 
-/* Global variables */
-static char *heap_listp;  /* pointer to first block */  
-#define NumofLists 32   //separate lists have 32 lists, each list is a size class:{1}, {2,3}, {4,5,6,7},{8,9,10,...15} ...
-/* function prototypes for internal helper routines */
-static void *extend_heap(size_t words);
-static void place(void *bp, size_t asize);
-static void *find_fit(size_t asize);
-static void *coalesce(void *bp);
-static void printblock(void *bp); 
-static void checkblock(void *bp);
+    /* A black node is gone: x carries an extra black up the tree */
+    while (x != Large_root && !RB_IS_RED(x)) {
+	if (x == RB_LEFT(xp)) {
+	    w = RB_RIGHT(xp);
+	    if (RB_IS_RED(w)) {
+		RB_SET_BLACK(w);
+		RB_SET_RED(xp);
+		rb_rotate_left(xp);
+		w = RB_RIGHT(xp);
+	    }
+	    if (!RB_IS_RED(RB_LEFT(w)) && !RB_IS_RED(RB_RIGHT(w))) {
+		RB_SET_RED(w);
+		x = xp;
+		xp = RB_PARENT(x);
+		continue;
+	    }
+	    if (!RB_IS_RED(RB_RIGHT(w))) {
+		RB_SET_BLACK(RB_LEFT(w));
+		RB_SET_RED(w);
+		rb_rotate_right(w);
+		w = RB_RIGHT(xp);
+	    }
+	    if (RB_IS_RED(xp))
+		RB_SET_RED(w);
+	    else
+		RB_SET_BLACK(w);
+	    RB_SET_BLACK(xp);
+	    RB_SET_BLACK(RB_RIGHT(w));
+	    rb_rotate_left(xp);
+	} else {
+	    w = RB_LEFT(xp);
+	    if (RB_IS_RED(w)) {
+		RB_SET_BLACK(w);
+		RB_SET_RED(xp);
+		rb_rotate_right(xp);
+		w = RB_LEFT(xp);
+	    }
+	    if (!RB_IS_RED(RB_LEFT(w)) && !RB_IS_RED(RB_RIGHT(w))) {
+		RB_SET_RED(w);
+		x = xp;
+		xp = RB_PARENT(x);
+		continue;
+	    }
+	    if (!RB_IS_RED(RB_LEFT(w))) {
+		RB_SET_BLACK(RB_RIGHT(w));
+		RB_SET_RED(w);
+		rb_rotate_left(w);
+		w = RB_LEFT(xp);
+	    }
+	    if (RB_IS_RED(xp))
+		RB_SET_RED(w);
+	    else
+		RB_SET_BLACK(w);
+	    RB_SET_BLACK(xp);
+	    RB_SET_BLACK(RB_LEFT(w));
+	    rb_rotate_right(xp);
+	}
+	x = Large_root;
+    }
+    if (x != NULL)
+	RB_SET_BLACK(x);
+}
 
-char* Separate_lists[NumofLists]={NULL,};  //separate lists for free blocks.
-int List_Index(size_t size)
+/*
+ * rb_reseat - If block nbp, of size bytes, falls between the neighbours
+ *     of tree node bp in the tree order, let it take bp's node and
+ *     return 1; else change nothing and return 0. A large block that
+ *     coalescing grows or place() splits usually keeps its place, and
+ *     so does not have to be taken out and put back. Caller updates
+ *     the headers afterwards.
+ */
+static int rb_reseat(char *bp, char *nbp, size_t size)
 {
-    int i=0;
-    while(1)
-    {
-        if(size)
-        {
-           size>>=1;
-           i++;
-        }
-        else 
-           return i-1;
+    char *p;
+
+    if (GET_SIZE(HDRP(bp)) < RB_MIN || size < RB_MIN)
+	return 0;
+
+    /* A block that shrinks can only fall below the one before it, and
+       one that grows can only rise above the one after it */
+    if (size < GET_SIZE(HDRP(bp))) {
+	if ((p = rb_prev(bp)) != NULL && (GET_SIZE(HDRP(p)) > size || 
+	    (GET_SIZE(HDRP(p)) == size && p > nbp)))
+	    return 0;
+    } else if ((p = rb_next(bp)) != NULL && (GET_SIZE(HDRP(p)) < size || 
+	(GET_SIZE(HDRP(p)) == size && p < nbp)))
+	return 0;
+    if (nbp != bp) {
+	if (bp == Large_min)
+	    Large_min = nbp;
+	PUT(PRED(nbp), GET(PRED(bp)));
+	PUT(SUCC(nbp), GET(SUCC(bp)));
+	PUT(RB_UP(nbp), GET(RB_UP(bp)));
+	rb_replace(RB_PARENT(bp), bp, nbp);
+	if (RB_LEFT(nbp) != NULL)
+	    RB_SET_PARENT(RB_LEFT(nbp), nbp);
+	if (RB_RIGHT(nbp) != NULL)
+	    RB_SET_PARENT(RB_RIGHT(nbp), nbp);
     }
+    return 1;
+}
+
+/*
+ * rb_check - Check the subtree at bp below parent for order, parent
+ *     links and colors, and return its black height
+ */
+static int rb_check(char *bp, char *parent)
+{
+    int lh, rh;
+
+    if (bp == NULL)
+	return 1;
+    if (RB_PARENT(bp) != parent)
+	printf("Error: tree node %p has the wrong parent\n", bp);
+    if (GET_ALLOC(HDRP(bp)) || GET_SIZE(HDRP(bp)) < RB_MIN)
+	printf("Error: tree node %p is allocated or small\n", bp);
+    if (RB_IS_RED(bp) && (RB_IS_RED(RB_LEFT(bp)) || RB_IS_RED(RB_RIGHT(bp))))
+	printf("Error: red tree node %p has a red child\n", bp);
+    if ((RB_LEFT(bp) && !RB_LESS(RB_LEFT(bp), bp)) ||
+	(RB_RIGHT(bp) && !RB_LESS(bp, RB_RIGHT(bp))))
+	printf("Error: tree nodes around %p are out of order\n", bp);
+    lh = rb_check(RB_LEFT(bp), bp);
+    rh = rb_check(RB_RIGHT(bp), bp);
+    if (lh != rh)
+	printf("Error: tree node %p has unequal black heights\n", bp);
+    return lh + !RB_IS_RED(bp);
 }
+/* $end rbtree */
 
-void Insert_List(char* bp)
+static void Insert_List(char* bp)
 {   
-    size_t successor;
+    char *successor;
     int index=List_Index(GET_SIZE(HDRP(bp)));
+
+    if(GET_SIZE(HDRP(bp))>=RB_MIN)
+    {
+        rb_insert(bp);
+        return;
+    }
+    if(Separate_lists[index]==NULL)
+        List_map[index>>5] |= 1u << (index&31);
+    if(policy==MM_ADDRESS)
+    {
+        tree_insert(index,bp);
+        return;
+    }
     /*
      Insert bp into the front of list
     */
     if(Separate_lists[index]!=NULL)  
     {
-        successor=(size_t)Separate_lists[index];
-        PUT(PRED(bp),0);
-        PUT(SUCC(bp),successor);
-        PUT(PRED(successor),(size_t)bp);
+        successor=Separate_lists[index];
+        PUT_PRED(bp,NULL);
+        PUT_SUCC(bp,successor);
+        PUT_PRED(successor,bp);
     }
     else
     {    
-        PUT(PRED(bp),0);
-        PUT(SUCC(bp),0);
+        PUT_PRED(bp,NULL);
+        PUT_SUCC(bp,NULL);
     }
     Separate_lists[index]=bp;
 }
-void Delete_List(char* bp)
+static void Delete_List(char* bp)
 {   
-    size_t pred=GET_PRED(bp);
-    size_t succ=GET_SUCC(bp);
+    char *pred, *succ;
     int index=List_Index(GET_SIZE(HDRP(bp)));
+
+    if(GET_SIZE(HDRP(bp))>=RB_MIN)
+    {
+        rb_delete(bp);
+        return;
+    }
+    if(policy==MM_ADDRESS)
+    {
+        tree_delete(index,bp);
+        if(Separate_lists[index]==NULL)
+            List_map[index>>5] &= ~(1u << (index&31));
+        return;
+    }
+    pred=GET_PRED(bp);
+    succ=GET_SUCC(bp);
+    if(Rovers[index]==bp)
+        Rovers[index]=succ;
     if(pred&&succ) //bp has predecessor and successor
     {
-        PUT(PRED(succ),pred);
-        PUT(SUCC(pred),succ);
+        PUT_PRED(succ,pred);
+        PUT_SUCC(pred,succ);
     }
     else if(pred&&!succ)
-        PUT(SUCC(pred),0);
+        PUT_SUCC(pred,NULL);
     else if(!pred&&succ)
     {
-        PUT(PRED(succ),0);
-        Separate_lists[index]=(char*)succ;
+        PUT_PRED(succ,NULL);
+        Separate_lists[index]=succ;
     }    
     else
+    {
         Separate_lists[index]=NULL;
+        List_map[index>>5] &= ~(1u << (index&31));
+    }
 }
 
 static void printblock(void *bp) 
 {
-    size_t hsize, halloc, fsize, falloc;
+    size_t hsize, halloc, hprev, fsize, falloc;
 
     hsize = GET_SIZE(HDRP(bp));
     halloc = GET_ALLOC(HDRP(bp));  
-    fsize = GET_SIZE(FTRP(bp));
-    falloc = GET_ALLOC(FTRP(bp));  
+    hprev = GET_PREV_ALLOC(HDRP(bp));
     
     if (hsize == 0) {
 	printf("%p: EOL\n", bp);
 	return;
     }
 
-    printf("%p: header: [%d:%c] footer: [%d:%c]\n", bp, 
-	   hsize, (halloc ? 'a' : 'f'), 
-	   fsize, (falloc ? 'a' : 'f')); 
+    if (halloc) {
+	printf("%p: header: [%u:%c%c]\n", bp, (unsigned)hsize, 
+	       (hprev ? 'p' : '-'), 'a');
+	return;
+    }
+    fsize = GET_SIZE(FTRP(bp));
+    falloc = GET_ALLOC(FTRP(bp));  
+    printf("%p: header: [%u:%c%c] footer: [%u:%c]\n", bp, 
+	   (unsigned)hsize, (hprev ? 'p' : '-'), 'f', 
+	   (unsigned)fsize, (falloc ? 'a' : 'f')); 
 }
 
 static void checkblock(void *bp) 
 {
-    if ((size_t)bp % 8)
-	printf("Error: %p is not doubleword aligned\n", bp);
-    if (GET(HDRP(bp)) != GET(FTRP(bp)))
+    if ((size_t)bp % ALIGNMENT)
+	printf("Error: %p is not %d-byte aligned\n", bp, ALIGNMENT);
+    if (!GET_ALLOC(HDRP(bp)) && 
+	GET_SIZE(HDRP(bp)) != GET(FTRP(bp)))
 	printf("Error: header does not match footer\n");
 }
 /* 
@@ -181,11 +1321,14 @@ static void checkblock(void *bp)
 void mm_checkheap(int verbose) 
 {
     char *bp = heap_listp;
+    mmap_chunk_t *c;
+    int i;
 
+    pthread_mutex_lock(&heap_lock);
     if (verbose)
 	printf("Heap (%p):\n", heap_listp);
 
-    if ((GET_SIZE(HDRP(heap_listp)) != DSIZE) || !GET_ALLOC(HDRP(heap_listp)))
+    if ((GET_SIZE(HDRP(heap_listp)) != ALIGNMENT) || !GET_ALLOC(HDRP(heap_listp)))
 	printf("Bad prologue header\n");
     checkblock(heap_listp);
 
@@ -193,28 +1336,107 @@ void mm_checkheap(int verbose)
 	if (verbose) 
 	    printblock(bp);
 	checkblock(bp);
+	if (!GET_ALLOC(HDRP(NEXT_BLKP(bp))) && !GET_ALLOC(HDRP(bp)))
+	    printf("Error: %p and its successor are both free\n", bp);
+	if (!GET_PREV_ALLOC(HDRP(NEXT_BLKP(bp))) != !GET_ALLOC(HDRP(bp)))
+	    printf("Error: prev-alloc bit after %p is wrong\n", bp);
     }
      
     if (verbose)
 	printblock(bp);
     if ((GET_SIZE(HDRP(bp)) != 0) || !(GET_ALLOC(HDRP(bp))))
 	printf("Bad epilogue header\n");
+    if (bp != (char *)mem_heap_hi() + 1)
+	printf("Error: epilogue %p is not at the heap break\n", bp);
+
+    rb_check(Large_root, NULL);
+    if (RB_IS_RED(Large_root))
+	printf("Error: tree root is red\n");
+    if (Large_min != rb_fit(0))
+	printf("Error: Large_min is not the first tree block\n");
+    for (i = 0; i < QUICK_LISTS; i++)
+	for (bp = Quick_lists[i]; bp != NULL; bp = QK_NEXT(bp))
+	    if (!GET_ALLOC(HDRP(bp)) || GET_SIZE(HDRP(bp)) != i * ALIGNMENT)
+		printf("Error: quick block %p is free or has the wrong size\n", bp);
+
+    for (c = Mmap_chunks; c != NULL; c = c->next) {
+	if (verbose)
+	    printf("%p: mapped [%lu]\n", (char *)c + MMAP_HDR, (unsigned long)c->len);
+	if (!mem_is_mapped(c, (char *)c + c->len - 1))
+	    printf("Error: huge block %p is not mapped\n", (char *)c + MMAP_HDR);
+	if (c->next && c->next->prev != c)
+	    printf("Error: Mmap_chunks links around %p are wrong\n", c);
+    }
+    pthread_mutex_unlock(&heap_lock);
+}
+
+/*
+ * mm_snapshot - Describe the free space of the heap: walk the blocks
+ *     like mm_checkheap, and count each free block under its class
+ */
+void mm_snapshot(mm_snap_t *snap)
+{
+    tcache_t *tc = tcache_get();
+    slab_run_t *run;
+    size_t size;
+    char *bp;
+    int i;
+
+    memset(snap, 0, sizeof(*snap));
+    pthread_mutex_lock(&heap_lock);
+    snap->heap = mem_heapsize();
+    for (bp = heap_listp; (size = GET_SIZE(HDRP(bp))) > 0; bp = NEXT_BLKP(bp)) {
+	if (GET_ALLOC(HDRP(bp)))
+	    continue;
+	i = Snap_Index(size);
+	snap->count[i]++;
+	snap->bytes[i] += size;
+	snap->nfree++;
+	snap->free += size;
+	snap->largest = MAX(snap->largest, size);
+    }
+    for (i = 0; i < SLAB_CLASSES; i++)
+	for (run = Slab_partial[i]; run != NULL; run = (slab_run_t *)TO_PTR(run->next))
+	    snap->slab_free += run->nfree * run->size;
+    for (i = 0; i < TCACHE_BINS; i++)
+	for (bp = tc->bins[i]; bp != NULL; bp = TC_NEXT(bp))
+	    snap->cached += usable_size(bp);
+    snap->cached += quick_bytes;
+    pthread_mutex_unlock(&heap_lock);
 }
+
 /* 
  * mm_init - Initialize the memory manager 
  */
 /* $begin mminit */
 int mm_init(void) 
 {  
+    pthread_once(&fork_once, fork_init);
+
     /* create the initial empty heap */
-    if ((heap_listp = mem_sbrk(4*WSIZE)) == NULL)
+    if ((heap_listp = mem_sbrk(2*ALIGNMENT)) == (void *)-1)
 	return -1;
-    PUT(heap_listp, 0);                        /* alignment padding */
-    PUT(heap_listp+WSIZE, PACK(OVERHEAD, 1));  /* prologue header */ 
-    PUT(heap_listp+DSIZE, PACK(OVERHEAD, 1));  /* prologue footer */ 
-    PUT(heap_listp+WSIZE+DSIZE, PACK(0, 1));   /* epilogue header */
-    heap_listp += DSIZE;
+    heap_base = heap_listp;
+    memset(heap_listp, 0, ALIGNMENT-WSIZE);    /* alignment padding */
+    heap_listp += ALIGNMENT;
+    PUT(HDRP(heap_listp), PACK(ALIGNMENT, 1) | PREV_ALLOC); /* prologue header */ 
+    PUT(FTRP(heap_listp), PACK(ALIGNMENT, 1)); /* prologue footer */ 
+    PUT(HDRP(NEXT_BLKP(heap_listp)), PACK(0, 1) | PREV_ALLOC); /* epilogue header */
     memset(Separate_lists,0,NumofLists*sizeof(char *));
+    memset(Rovers,0,sizeof(Rovers));
+    Large_root = Large_min = NULL;
+    policy = next_policy;
+    policy_k = next_policy_k;
+    memset(List_map,0,sizeof(List_map));
+    memset(Slab_pages,0,slab_pages_hi*sizeof(unsigned int));
+    memset(Slab_partial,0,sizeof(Slab_partial));
+    memset(Quick_lists,0,sizeof(Quick_lists));
+    quick_bytes = 0;
+    slab_pages_hi = 0;
+    Mmap_chunks = NULL;  /* mem_reset_brk has unmapped them */
+    mmap_threshold = MMAP_THRESHOLD;
+    trim_threshold = TRIM_THRESHOLD;
+    heap_epoch++;  /* every thread's tcache now refers to a stale heap */
     /* Extend the empty heap with a free block of CHUNKSIZE bytes */
     if (extend_heap(CHUNKSIZE/WSIZE) == NULL)
 	return -1;
@@ -228,31 +1450,31 @@ int mm_init(void)
 /* $begin mmmalloc */
 void *mm_malloc(size_t size) 
 {
-    size_t asize;      /* adjusted block size */
-    size_t extendsize; /* amount to extend heap if no fit */
+    tcache_t *tc;
     char *bp;      
+    int idx;
 
-    /* Ignore spurious requests */
-    if (size <= 0)
+    /* Ignore spurious requests, and refuse impossible ones */
+    if (size == 0 || size > MAX_REQUEST)
 	return NULL;
 
-    /* Adjust block size to include overhead ,successor pointer and alignment reqs. */
-    if (size <= DSIZE)
-	asize = DSIZE + OVERHEAD;
-    else
-	asize = DSIZE * ((size + (OVERHEAD) + (DSIZE-1)) / DSIZE);
-    
-    /* Search the free list for a fit */
-    if ((bp = find_fit(asize)) != NULL) {
-	place(bp, asize);
-	return bp;
+    /* Small requests are served from the thread's cache when possible;
+       test the size before TC_INDEX, which a huge one would overflow */
+    if (size <= TC_MAX) {
+	idx = TC_INDEX(size);
+	tc = tcache_get();
+	if (tc->bins[idx] == NULL)
+	    tcache_refill(tc, idx);
+	if ((bp = tc->bins[idx]) != NULL) {
+	    tc->bins[idx] = TC_NEXT(bp);
+	    tc->count[idx]--;
+	    return bp;
+	}
     }
 
-    /* No fit found. Get more memory and place the block */
-    extendsize = MAX(asize,CHUNKSIZE);
-    if ((bp = extend_heap(extendsize/WSIZE)) == NULL)
-	return NULL;
-    place(bp, asize);
+    pthread_mutex_lock(&heap_lock);
+    bp = heap_malloc(size);
+    pthread_mutex_unlock(&heap_lock);
     return bp;
 } 
 /* $end mmmalloc */
@@ -263,90 +1485,495 @@ void *mm_malloc(size_t size)
 /* $begin mmfree */
 void mm_free(void *bp)
 {
-    size_t size = GET_SIZE(HDRP(bp));
+    tcache_t *tc;
+    size_t usable = usable_size(bp);
+    int idx;
 
-    PUT(HDRP(bp), PACK(size, 0));
-    PUT(FTRP(bp), PACK(size, 0));
-    coalesce(bp);
+    /* Small blocks go to the thread's cache, still marked allocated */
+    if (usable < TCACHE_BINS * ALIGNMENT) {
+	idx = TC_CLASS(usable);
+	tc = tcache_get();
+	if (tc->count[idx] >= TCACHE_COUNT)
+	    tcache_drain(tc, idx, TCACHE_BATCH);
+	TC_NEXT(bp) = tc->bins[idx];
+	tc->bins[idx] = bp;
+	tc->count[idx]++;
+	return;
+    }
+
+    pthread_mutex_lock(&heap_lock);
+    heap_free(bp);
+    pthread_mutex_unlock(&heap_lock);
 }
 
 /* $end mmfree */
 
 /*
- * mm_realloc - naive implementation of mm_realloc
+ * mm_realloc - Resize a slab object or a block, in place whenever its
+ *     neighbours or the heap tail allow it (see realloc_block). Returns
+ *     NULL, leaving ptr as it was, if there is no room.
  */
 void *mm_realloc(void *ptr, size_t size)
 {
-    void *newp;
+    void *newp = NULL;
     size_t copySize,asize;
-    void * next_ptr;
     if(ptr==NULL)
        return mm_malloc(size);
     if(size==0)
     {
-        free(ptr);
+        mm_free(ptr);
         return NULL;
     }
-    copySize = GET_SIZE(HDRP(ptr));
-    if (size <= 0)
-	return NULL;
-
-    /* Adjust block size to include overhead ,successor pointer and alignment reqs. */
-    if (size <= DSIZE)
-	asize = DSIZE + OVERHEAD;
-    else
-	asize = DSIZE * ((size + (OVERHEAD) + (DSIZE-1)) / DSIZE);
+    if(size>MAX_REQUEST)  //adjust_size would wrap and look like a shrink
+        return NULL;
+    asize = adjust_size(size);
 
-    if(GET_SIZE(HDRP(ptr))>=asize)  //oldsize is bigger(or equal) than new size, so we don't need to copy data, just resize current block.
-    {  
-       size_t remain_size=GET_SIZE(HDRP(ptr))-asize;
-       if(remain_size>=(DSIZE+OVERHEAD))  //split if remainder would be at least minimum block size
-       {   
-           PUT(HDRP(ptr),PACK(asize,1));
-           PUT(FTRP(ptr),PACK(asize,1));
-           next_ptr=NEXT_BLKP(ptr);
-           PUT(HDRP(next_ptr),PACK(remain_size,0));
-           PUT(FTRP(next_ptr),PACK(remain_size,0));
-           coalesce(next_ptr);
-       }
-    }
-    else if(!GET_ALLOC(HDRP(NEXT_BLKP(ptr)))&&GET_SIZE(HDRP(ptr))+GET_SIZE(HDRP(NEXT_BLKP(ptr)))>=asize)
-    //coalesce with next block would satisfy, no need to transfer data.
-    {   
-        int coale_size=GET_SIZE(HDRP(ptr))+GET_SIZE(HDRP(NEXT_BLKP(ptr)));
-        Delete_List(NEXT_BLKP(ptr));
-        if(coale_size-asize>=(DSIZE+OVERHEAD))  //split if remainder would be at least minimum block size
-        {   
-           PUT(HDRP(ptr),PACK(asize,1));
-           PUT(FTRP(ptr),PACK(asize,1));
-           next_ptr=NEXT_BLKP(ptr);
-           PUT(HDRP(next_ptr),PACK(coale_size-asize,0));
-           PUT(FTRP(next_ptr),PACK(coale_size-asize,0));
-           coalesce(next_ptr);
-        }
-        else
+    pthread_mutex_lock(&heap_lock);
+    if(!IN_HEAP(ptr))  //huge blocks are remapped, unless they get small
+    {
+        /* mmap_free may have raised mmap_threshold past the block's
+           size since it was mapped: copy no more than it holds */
+        if(size>=mmap_threshold)
+            newp=mmap_realloc(ptr,size);
+        else if((newp=heap_malloc(size))!=NULL)
         {
-           PUT(HDRP(ptr),PACK(coale_size,1));
-           PUT(FTRP(ptr),PACK(coale_size,1));
+            memcpy(newp, ptr, MIN(size, usable_size(ptr)));
+            mmap_free(ptr);
         }
     }
-    else  //we need search for a bigger block in free lists and copy data as well.
+    else if(IS_SLAB(ptr))  //slab objects are kept if big enough, else moved
     {
-        if ((newp = mm_malloc(size)) == NULL) {
-            printf("ERROR: mm_malloc failed in mm_realloc\n");
-            exit(1);
+        copySize=SLAB_OF(ptr)->size;
+        newp=ptr;
+        if(size>copySize && (newp = heap_malloc(size)) != NULL)
+        {
+            memcpy(newp, ptr, copySize);
+            slab_free(ptr);
         }
-        if(size<copySize)
-            copySize=size;
-         memcpy(newp, ptr,copySize);
-         mm_free(ptr);
-         return newp;
     }
-    return ptr;
+    else
+        newp = realloc_block(ptr, asize);
+    pthread_mutex_unlock(&heap_lock);
+    return newp;
+}
+
+/*
+ * mm_malloc_batch - Allocate n blocks of size bytes into out[] under a
+ *     single lock. Small requests come from the slab runs; larger ones
+ *     are carved back to back from each free region found, with one
+ *     list removal and one split per region rather than per block.
+ *     Returns the number of blocks allocated.
+ */
+int mm_malloc_batch(size_t size, int n, void **out)
+{
+    size_t asize, csize, k;
+    char *bp;
+    int i = 0;
+
+    if (size == 0 || size > MAX_REQUEST || n <= 0)
+	return 0;
+
+    pthread_mutex_lock(&heap_lock);
+    if (size <= SLAB_MAX || size >= mmap_threshold) {
+	for (; i < n; i++)
+	    if ((out[i] = heap_malloc(size)) == NULL)
+		break;
+	pthread_mutex_unlock(&heap_lock);
+	return i;
+    }
+
+    /* Carve as many blocks as fit from each region found */
+    asize = adjust_size(size);
+    while (i < n) {
+	if ((bp = find_fit(asize)) == NULL && quick_bytes > 0) {
+	    quick_flush();            /* as malloc_block does */
+	    bp = find_fit(asize);
+	}
+	if (bp == NULL &&
+	    (bp = extend_heap(MAX(asize * (n - i), CHUNKSIZE)/WSIZE)) == NULL)
+	    break;
+	k = MIN((size_t)(n - i), GET_SIZE(HDRP(bp)) / asize);
+	place(bp, k * asize);
+	csize = GET_SIZE(HDRP(bp));   /* the last block keeps any slack */
+	for (; k > 1; k--, bp += asize, csize -= asize) {
+	    PUT(HDRP(bp), PACK(asize, 1) | GET_PREV_ALLOC(HDRP(bp)));
+	    PUT(HDRP(bp + asize), PACK(csize - asize, 1) | PREV_ALLOC);
+	    out[i++] = bp;
+	}
+	out[i++] = bp;
+    }
+    pthread_mutex_unlock(&heap_lock);
+    return i;
+}
+
+/*
+ * ptr_cmp - qsort comparison of two block pointers by address
+ */
+static int ptr_cmp(const void *a, const void *b)
+{
+    char *p = *(char **)a, *q = *(char **)b;
+
+    return (p > q) - (p < q);
+}
+
+/*
+ * mm_free_batch - Free n blocks under a single lock. The pointers are
+ *     sorted by address first, so that each run of physically adjacent
+ *     blocks becomes one free block that is coalesced with its
+ *     neighbours and inserted in the lists only once.
+ */
+void mm_free_batch(void **ptrs, int n)
+{
+    char *bp;
+    size_t size;
+    int i = 0;
+
+    pthread_mutex_lock(&heap_lock);
+    qsort(ptrs, n, sizeof(void *), ptr_cmp);
+    while (i < n) {
+	if ((bp = ptrs[i++]) == NULL)
+	    continue;
+	if (!IN_HEAP(bp) || IS_SLAB(bp)) {
+	    heap_free(bp);
+	    continue;
+	}
+	size = GET_SIZE(HDRP(bp));
+	while (i < n && (char *)ptrs[i] == bp + size)
+	    size += GET_SIZE(HDRP(ptrs[i++]));
+	PUT(HDRP(bp), PACK(size, 0) | GET_PREV_ALLOC(HDRP(bp)));
+	PUT(FTRP(bp), PACK(size, 0));
+	CLR_PREV_ALLOC(HDRP(NEXT_BLKP(bp)));
+	trim_heap(coalesce(bp));
+    }
+    pthread_mutex_unlock(&heap_lock);
+}
+
+/*
+ * mm_memalign - Allocate size bytes at a multiple of align, a power of
+ *     two. Alignments above ALIGNMENT are carved from the heap with
+ *     malloc_aligned, which aligns relative to the heap base, so they
+ *     are only available when the heap base is itself that aligned.
+ */
+void *mm_memalign(size_t align, size_t size)
+{
+    char *bp;
+
+    if (align <= ALIGNMENT)
+	return mm_malloc(size);
+    if (size == 0 || size > (1u<<31) || ((size_t)heap_base & (align-1)))
+	return NULL;
+
+    pthread_mutex_lock(&heap_lock);
+    bp = malloc_aligned(adjust_size(size), align);
+    pthread_mutex_unlock(&heap_lock);
+    return bp;
+}
+
+/*
+ * mm_usable_size - Payload bytes of the allocated block ptr, 0 for NULL
+ */
+size_t mm_usable_size(void *ptr)
+{
+    return ptr ? usable_size(ptr) : 0;
+}
+
+/*
+ * mm_set_policy - Use placement policy p from the next mm_init on,
+ *     with best-fit looking at up to k blocks (8 if k <= 0). Returns
+ *     -1 if there is no such policy. The policy only places blocks
+ *     below RB_MIN bytes; larger ones are always a best fit from the
+ *     tree.
+ */
+int mm_set_policy(int p, int k)
+{
+    if (p < 0 || p >= MM_POLICIES)
+	return -1;
+    next_policy = p;
+    next_policy_k = k > 0 ? k : 8;
+    return 0;
 }
 
 /* The remaining routines are internal helper routines */
 
+/*
+ * adjust_size - Block size needed for a request of size payload bytes,
+ *     at most MAX_REQUEST
+ */
+static size_t adjust_size(size_t size)
+{
+    /* Adjust block size to include the header and alignment reqs; the
+       block must also be able to hold its free-list links and footer
+       once it is freed. */
+    return MAX(MINBLOCK, ALIGN(size + OVERHEAD));
+}
+
+/*
+ * malloc_block - Allocate a block of asize bytes. Caller holds heap_lock.
+ */
+static void *malloc_block(size_t asize)
+{
+    size_t extendsize; /* amount to extend heap if no fit */
+    char *bp;
+
+    /* A quick block of the exact size, else a fit from the free lists,
+       else a fit once the quick blocks are coalesced. A large request
+       coalesces them first, so that they cannot cut it off from free
+       space next to them. */
+    if ((bp = quick_malloc(asize)) != NULL)
+	return bp;
+    if (asize > QUICK_MAX && quick_bytes > 0)
+	quick_flush();
+    if ((bp = find_fit(asize)) != NULL ||
+	(quick_bytes > 0 && (quick_flush(), bp = find_fit(asize)) != NULL)) {
+	place(bp, asize);
+	return bp;
+    }
+
+    /* No fit found. Get more memory and place the block */
+    extendsize = MAX(asize,CHUNKSIZE);
+    if ((bp = extend_heap(extendsize/WSIZE)) == NULL)
+	return NULL;
+    place(bp, asize);
+    return bp;
+}
+
+/*
+ * align_in - First payload address in free block bp that is a multiple
+ *     of align from the heap base and leaves either nothing or room for
+ *     a free block in front of it
+ */
+static char *align_in(char *bp, size_t align)
+{
+    char *ap = heap_base + (((size_t)(bp - heap_base) + align-1) & ~(align-1));
+
+    while (ap != bp && ap - bp < MINBLOCK)
+	ap += align;
+    return ap;
+}
+
+/*
+ * aligned_fit - Any free block with an aligned spot for asize bytes
+ *     (see align_in), or NULL
+ */
+static void *aligned_fit(size_t asize, size_t align)
+{
+    char *bp;
+    int index;
+
+    for (index = List_Index(asize); index >= 0; index = Next_List(index))
+	for (bp = List_First(index); bp != NULL; bp = List_Next(index, bp))
+	    if (align_in(bp, align) + asize <= bp + GET_SIZE(HDRP(bp)))
+		return bp;
+    for (bp = rb_fit(asize); bp != NULL; bp = rb_next(bp))
+	if (align_in(bp, align) + asize <= bp + GET_SIZE(HDRP(bp)))
+	    return bp;
+    return NULL;
+}
+
+/*
+ * malloc_aligned - Allocate a block of asize bytes whose payload lies
+ *     at a multiple of align (a power of two) from the heap base. Any
+ *     space in front of it is split off as a free block. Caller holds
+ *     heap_lock.
+ */
+static void *malloc_aligned(size_t asize, size_t align)
+{
+    size_t need = asize + align + MINBLOCK, csize, front;
+    char *bp, *ap;
+
+    /* A fit, else a fit once the quick blocks are coalesced, else
+       more heap */
+    if ((bp = aligned_fit(asize, align)) == NULL && quick_bytes > 0) {
+	quick_flush();
+	bp = aligned_fit(asize, align);
+    }
+    if (bp == NULL && (bp = extend_heap(MAX(need, CHUNKSIZE)/WSIZE)) == NULL)
+	return NULL;
+    ap = align_in(bp, align);
+
+    if ((front = ap - bp) > 0) {
+	csize = GET_SIZE(HDRP(bp));
+	Delete_List(bp);
+	PUT(HDRP(bp), PACK(front, 0) | PREV_ALLOC);
+	PUT(FTRP(bp), PACK(front, 0));
+	Insert_List(bp);
+	PUT(HDRP(ap), PACK(csize-front, 0));  /* previous block is free */
+	PUT(FTRP(ap), PACK(csize-front, 0));
+	Insert_List(ap);
+    }
+    place(ap, asize);
+    return ap;
+}
+
+/*
+ * heap_malloc - Allocate size bytes from a slab or as a block of its
+ *     own. Caller holds heap_lock.
+ */
+static void *heap_malloc(size_t size)
+{
+    if (size == 0)
+	return NULL;
+    if (size <= SLAB_MAX)
+	return slab_malloc(size);
+    if (size >= mmap_threshold)
+	return mmap_malloc(size);
+    return malloc_block(adjust_size(size));
+}
+
+/*
+ * heap_free - Free a slab object or a block, holding small blocks on
+ *     the quick lists. Caller holds heap_lock.
+ */
+static void heap_free(void *bp)
+{
+    if (!IN_HEAP(bp))
+	mmap_free(bp);
+    else if (IS_SLAB(bp))
+	slab_free(bp);
+    else if (GET_SIZE(HDRP(bp)) <= QUICK_MAX)
+	quick_free(bp);
+    else
+	free_block(bp);
+}
+
+/*
+ * usable_size - Payload bytes available in an allocated slab object
+ *     or block
+ */
+static size_t usable_size(void *bp)
+{
+    if (!IN_HEAP(bp))
+	return CHUNK_OF(bp)->len - MMAP_HDR;
+    if (IS_SLAB(bp))
+	return SLAB_OF(bp)->size;
+    return GET_SIZE(HDRP(bp)) - OVERHEAD;
+}
+
+/*
+ * free_block - Free a block and coalesce it. Caller holds heap_lock.
+ */
+static void free_block(void *bp)
+{
+    size_t size = GET_SIZE(HDRP(bp));
+
+    PUT(HDRP(bp), PACK(size, 0) | GET_PREV_ALLOC(HDRP(bp)));
+    PUT(FTRP(bp), PACK(size, 0));
+    CLR_PREV_ALLOC(HDRP(NEXT_BLKP(bp)));
+    trim_heap(coalesce(bp));
+}
+
+/*
+ * trim_heap - If free block bp is the last block and at least
+ *     trim_threshold bytes, shrink the heap so that only CHUNKSIZE
+ *     bytes of it are left. Caller holds heap_lock.
+ */
+static void trim_heap(void *bp)
+{
+    size_t size = GET_SIZE(HDRP(bp));
+
+    if (size < trim_threshold || GET_SIZE(HDRP(NEXT_BLKP(bp))) != 0)
+	return;
+    if (mem_sbrk(-(intptr_t)(size - CHUNKSIZE)) == (void *)-1)
+	return;
+    Delete_List(bp);
+    PUT(HDRP(bp), PACK(CHUNKSIZE, 0) | PREV_ALLOC);
+    PUT(FTRP(bp), PACK(CHUNKSIZE, 0));
+    PUT(HDRP(NEXT_BLKP(bp)), PACK(0, 1));   /* new epilogue */
+    Insert_List(bp);
+}
+
+/*
+ * realloc_block - Resize allocated block bp to asize bytes, preferring
+ *     in order: shrinking in place, absorbing a free next block,
+ *     growing the heap when bp is the last block, sliding down into a
+ *     free previous block, and only then moving the payload. Blocks
+ *     that have been grown before are given half again as much as
+ *     they asked for whenever the payload has to be copied, so a block
+ *     grown n times in small steps is copied O(log n) times. Caller
+ *     holds heap_lock.
+ */
+static void *realloc_block(void *bp, size_t asize)
+{
+    size_t csize = GET_SIZE(HDRP(bp)), rsize = asize, size;
+    char *next = NEXT_BLKP(bp), *last = bp, *prev, *newp;
+
+    if (csize >= asize) {
+	shrink_block(bp, asize);
+	return bp;
+    }
+    if (GET_GROWN(HDRP(bp)))
+	rsize = ALIGN(asize + asize/2);
+
+    /* Last block (or last but a free one): make the heap tail fit,
+       unless the block is becoming a huge one */
+    size = csize;
+    if (!GET_ALLOC(HDRP(next))) {
+	size += GET_SIZE(HDRP(next));
+	last = next;
+    }
+    if (size < asize && asize - OVERHEAD < mmap_threshold &&
+	GET_SIZE(HDRP(NEXT_BLKP(last))) == 0) {
+	if (extend_heap((asize - size)/WSIZE) == NULL)
+	    return NULL;
+	next = NEXT_BLKP(bp);
+    }
+
+    /* Absorb a free next block */
+    if (!GET_ALLOC(HDRP(next)) && csize + GET_SIZE(HDRP(next)) >= asize) {
+	Delete_List(next);
+	csize += GET_SIZE(HDRP(next));
+	PUT(HDRP(bp), PACK(csize, 1) | GET_PREV_ALLOC(HDRP(bp)) | GROWN);
+	SET_PREV_ALLOC(HDRP(NEXT_BLKP(bp)));
+	shrink_block(bp, MIN(rsize, csize));
+	return bp;
+    }
+
+    /* Slide down into a free previous block, taking a free next too */
+    if (!GET_PREV_ALLOC(HDRP(bp))) {
+	prev = PREV_BLKP(bp);
+	size = GET_SIZE(HDRP(prev)) + csize;
+	if (!GET_ALLOC(HDRP(next)))
+	    size += GET_SIZE(HDRP(next));
+	if (size >= asize) {
+	    Delete_List(prev);
+	    if (!GET_ALLOC(HDRP(next)))
+		Delete_List(next);
+	    memmove(prev, bp, csize - OVERHEAD);
+	    PUT(HDRP(prev), PACK(size, 1) | PREV_ALLOC | GROWN);
+	    SET_PREV_ALLOC(HDRP(NEXT_BLKP(prev)));
+	    shrink_block(prev, MIN(rsize, size));
+	    return prev;
+	}
+    }
+
+    /* Move the payload to a new block, slab object or huge block; only
+       a block has a header to tag */
+    if ((newp = heap_malloc(rsize - OVERHEAD)) == NULL)
+	return NULL;
+    memcpy(newp, bp, csize - OVERHEAD);
+    if (IN_HEAP(newp) && !IS_SLAB(newp))
+	PUT(HDRP(newp), GET(HDRP(newp)) | GROWN);
+    free_block(bp);
+    return newp;
+}
+
+/*
+ * shrink_block - Trim allocated block bp down to asize bytes, freeing
+ *     the rest if it is big enough to be a block. Caller holds heap_lock.
+ */
+static void shrink_block(void *bp, size_t asize)
+{
+    size_t csize = GET_SIZE(HDRP(bp));
+    char *rest;
+
+    if (csize - asize < MINBLOCK)
+	return;
+    PUT(HDRP(bp), PACK(asize, 1) | (GET(HDRP(bp)) & (PREV_ALLOC | GROWN)));
+    rest = NEXT_BLKP(bp);
+    PUT(HDRP(rest), PACK(csize - asize, 1) | PREV_ALLOC);
+    free_block(rest);
+}
+
 /* 
  * extend_heap - Extend heap with free block and return its block pointer
  */
@@ -356,13 +1983,13 @@ static void *extend_heap(size_t words)
     char *bp;
     size_t size;
 	
-    /* Allocate an even number of words to maintain alignment */
-    size = (words % 2) ? (words+1) * WSIZE : words * WSIZE;
-    if ((bp = mem_sbrk(size)) == (void *)-1) 
+    /* Allocate a multiple of ALIGNMENT bytes to maintain alignment */
+    size = ALIGN(words * WSIZE);
+    if (mem_heapsize() + size > HEAP_LIMIT || (bp = mem_sbrk(size)) == (void *)-1) 
 	return NULL;
 
     /* Initialize free block header/footer and the epilogue header */
-    PUT(HDRP(bp), PACK(size, 0));         /* free block header */
+    PUT(HDRP(bp), PACK(size, 0) | GET_PREV_ALLOC(HDRP(bp))); /* free block header */
     PUT(FTRP(bp), PACK(size, 0));         /* free block footer */
     PUT(HDRP(NEXT_BLKP(bp)), PACK(0, 1)); /* new epilogue header */
     
@@ -381,45 +2008,91 @@ static void place(void *bp, size_t asize)
 /* $end mmplace-proto */
 {
     size_t csize = GET_SIZE(HDRP(bp));   
-    Delete_List(bp);
-    if ((csize - asize) >= (DSIZE + OVERHEAD)) { //split if remainder would be at least minimum block size
-	PUT(HDRP(bp), PACK(asize, 1));
-	PUT(FTRP(bp), PACK(asize, 1));
+    int stay;
+
+    if ((csize - asize) >= MINBLOCK) { //split if remainder would be at least minimum block size
+	if (!(stay = rb_reseat(bp, (char *)bp + asize, csize-asize)))
+	    Delete_List(bp);
+	PUT(HDRP(bp), PACK(asize, 1) | GET_PREV_ALLOC(HDRP(bp)));
 	bp = NEXT_BLKP(bp);
-	PUT(HDRP(bp), PACK(csize-asize, 0));
+	PUT(HDRP(bp), PACK(csize-asize, 0) | PREV_ALLOC);
 	PUT(FTRP(bp), PACK(csize-asize, 0));
-    Insert_List(bp);
+	if (!stay)
+	    Insert_List(bp);
     }
     else { 
-	PUT(HDRP(bp), PACK(csize, 1));
-	PUT(FTRP(bp), PACK(csize, 1));
+	Delete_List(bp);
+	PUT(HDRP(bp), PACK(csize, 1) | GET_PREV_ALLOC(HDRP(bp)));
+	SET_PREV_ALLOC(HDRP(NEXT_BLKP(bp)));
     }
 }
 /* $end mmplace */
 
 /* 
- * find_fit - Find a fit for a block with asize bytes 
+ * find_fit - Find a fit for a block with asize bytes: from the lists
+ *     if it is small and they have one, else the best fit of the tree
  */
 static void *find_fit(size_t asize)
 {
-    /* separate lists first fit search */
     char *bp;
-    int index=List_Index(asize);
-    bp=Separate_lists[index];
 
-    while(1)
-    {   
-        while(bp==NULL)
-        {
-            index++;
-            if(index>=32)
-            return NULL; /* no fit found*/    
-            bp=Separate_lists[index];
-        }
-        if(GET_SIZE(HDRP(bp))>asize) //This block is big enough 
-            return bp;
-        else 
-            bp=(char *)GET_SUCC(bp); 
+    if (asize >= RB_MIN)
+	return rb_fit(asize);
+    if ((bp = list_fit(asize)) != NULL)
+	return bp;
+    return Large_min;
+}
+
+/*
+ * list_fit - Find a fit for a block with asize bytes on the lists, by
+ *     the placement policy. The blocks of asize's own list may be too
+ *     small, but any block of a higher list fits.
+ */
+static void *list_fit(size_t asize)
+{
+    char *bp, *best = NULL, *start;
+    int index = List_Index(asize), n = 0;
+
+    switch (policy) {
+    case MM_BESTFIT:
+	for (bp = Separate_lists[index]; bp != NULL && n < policy_k; bp = GET_SUCC(bp))
+	    if (GET_SIZE(HDRP(bp)) >= asize) {
+		if (best == NULL || GET_SIZE(HDRP(bp)) < GET_SIZE(HDRP(best)))
+		    best = bp;
+		if (GET_SIZE(HDRP(bp)) == asize)
+		    break;
+		n++;
+	    }
+	if (best != NULL || (index = Next_List(index)) < 0)
+	    return best;
+	for (bp = Separate_lists[index]; bp != NULL && n < policy_k; bp = GET_SUCC(bp), n++)
+	    if (best == NULL || GET_SIZE(HDRP(bp)) < GET_SIZE(HDRP(best)))
+		best = bp;
+	return best;
+
+    case MM_NEXTFIT:
+	/* From the rover to the end of the list, then from its front */
+	start = Rovers[index] ? Rovers[index] : Separate_lists[index];
+	for (bp = start; bp != NULL; bp = GET_SUCC(bp))
+	    if (GET_SIZE(HDRP(bp)) >= asize)
+		goto nextfit;
+	for (bp = Separate_lists[index]; bp != start; bp = GET_SUCC(bp))
+	    if (GET_SIZE(HDRP(bp)) >= asize)
+		goto nextfit;
+	if ((index = Next_List(index)) < 0)
+	    return NULL;
+	bp = Rovers[index] ? Rovers[index] : Separate_lists[index];
+    nextfit:
+	Rovers[index] = GET_SUCC(bp);
+	return bp;
+
+    default:  /* MM_LIFO and MM_ADDRESS: first fit */
+	for (bp = List_First(index); bp != NULL; bp = List_Next(index, bp))
+	    if (GET_SIZE(HDRP(bp)) >= asize)
+		return bp;
+	if ((index = Next_List(index)) < 0)
+	    return NULL;
+	return List_First(index);
     }
 }
 
@@ -429,9 +2102,10 @@ static void *find_fit(size_t asize)
  */
 static void *coalesce(void *bp) 
 {
-    size_t prev_alloc=GET_ALLOC(FTRP(PREV_BLKP(bp)));
+    size_t prev_alloc=GET_PREV_ALLOC(HDRP(bp));
     size_t next_alloc=GET_ALLOC(HDRP(NEXT_BLKP(bp)));
     size_t size=GET_SIZE(HDRP(bp));
+    int stay=0;  //the block keeps a neighbour's place in the tree
     if(prev_alloc&&next_alloc)  //previous block and next block are all allocated
     {  
        Insert_List(bp);  
@@ -439,29 +2113,33 @@ static void *coalesce(void *bp)
     }
     else if(prev_alloc&&!next_alloc)//coalesce with next block
     {  
-       Delete_List(NEXT_BLKP(bp));  //next free block no longer exist in the separate list.
        size+=GET_SIZE(HDRP(NEXT_BLKP(bp)));
-       PUT(HDRP(bp),PACK(size,0)); //update header
+       if(!(stay=rb_reseat(NEXT_BLKP(bp),bp,size)))
+           Delete_List(NEXT_BLKP(bp));  //next free block no longer exist in the separate list.
+       PUT(HDRP(bp),PACK(size,0)|PREV_ALLOC); //update header
        PUT(FTRP(bp),PACK(size,0)); //update footer
     }
     else if(!prev_alloc&&next_alloc)//coalesce with previous block
     {
-       Delete_List(PREV_BLKP(bp));
        size+=GET_SIZE(FTRP(PREV_BLKP(bp)));
-       PUT(HDRP(PREV_BLKP(bp)),PACK(size,0)); //update header
+       if(!(stay=rb_reseat(PREV_BLKP(bp),PREV_BLKP(bp),size)))
+           Delete_List(PREV_BLKP(bp));
+       PUT(HDRP(PREV_BLKP(bp)),PACK(size,0)|PREV_ALLOC); //update header
        PUT(FTRP(bp),PACK(size,0)); //update footer
        bp=PREV_BLKP(bp);
     } 
     else  //coalesce with previous block & next block
     {  
-       Delete_List(PREV_BLKP(bp));
        Delete_List(NEXT_BLKP(bp));
        size+=GET_SIZE(FTRP(PREV_BLKP(bp)))+GET_SIZE(HDRP(NEXT_BLKP(bp)));
-       PUT(HDRP(PREV_BLKP(bp)),PACK(size,0)); //update header
+       if(!(stay=rb_reseat(PREV_BLKP(bp),PREV_BLKP(bp),size)))
+           Delete_List(PREV_BLKP(bp));
+       PUT(HDRP(PREV_BLKP(bp)),PACK(size,0)|PREV_ALLOC); //update header
        PUT(FTRP(NEXT_BLKP(bp)),PACK(size,0));
        bp=PREV_BLKP(bp);
     }
-    Insert_List(bp);  
+    if(!stay)
+       Insert_List(bp);  
     return bp;
 }
 
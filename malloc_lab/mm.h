@@ -1,10 +1,97 @@
 #include <stdio.h>
 
+/*
+ * Compiled with -DMM_PREFIX=p, a package names its globals p_mm_init,
+ * p_mm_malloc, ..., p_team instead, so that several builds of it can
+ * be linked into one program (see mmvariants.c).
+ */
+#ifdef MM_PREFIX
+#define MM_CAT(p, name)   p##name
+#define MM_NAME(p, name)  MM_CAT(p, name)
+#define mm_init           MM_NAME(MM_PREFIX, mm_init)
+#define mm_malloc         MM_NAME(MM_PREFIX, mm_malloc)
+#define mm_free           MM_NAME(MM_PREFIX, mm_free)
+#define mm_realloc        MM_NAME(MM_PREFIX, mm_realloc)
+#define mm_malloc_batch   MM_NAME(MM_PREFIX, mm_malloc_batch)
+#define mm_free_batch     MM_NAME(MM_PREFIX, mm_free_batch)
+#define mm_memalign       MM_NAME(MM_PREFIX, mm_memalign)
+#define mm_usable_size    MM_NAME(MM_PREFIX, mm_usable_size)
+#define mm_snapshot       MM_NAME(MM_PREFIX, mm_snapshot)
+#define mm_set_policy     MM_NAME(MM_PREFIX, mm_set_policy)
+#define mm_checkheap      MM_NAME(MM_PREFIX, mm_checkheap)
+#define team              MM_NAME(MM_PREFIX, team)
+#endif
+
 extern int mm_init (void);
 extern void *mm_malloc (size_t size);
 extern void mm_free (void *ptr);
 extern void *mm_realloc(void *ptr, size_t size);
 
+/*
+ * Batch interface: mm_malloc_batch allocates n blocks of size bytes
+ * into out[] and returns how many it got (n unless the heap ran out);
+ * mm_free_batch frees the n blocks in ptrs[], which it may reorder.
+ */
+extern int mm_malloc_batch(size_t size, int n, void **out);
+extern void mm_free_batch(void **ptrs, int n);
+
+/*
+ * Only mm.c provides these, for mmshim.c: mm_memalign allocates size
+ * bytes at a multiple of align (NULL if it cannot), mm_usable_size
+ * returns the payload bytes of an allocated block.
+ */
+extern void *mm_memalign(size_t align, size_t size);
+extern size_t mm_usable_size(void *ptr) __attribute__((weak));
+
+/*
+ * Heap snapshots, for mdriver -F. mm_snapshot describes the free space
+ * of the heap: its free blocks, by the free list (size class) each is
+ * on, and the free space hidden in slab runs and in the calling
+ * thread's cache. Class i holds the sizes from 2^(i/4) up, the four
+ * classes of each power of two splitting it evenly. Only mm.c provides
+ * mm_snapshot, so it and mm_usable_size are weak: mdriver tests them
+ * for NULL before it calls them.
+ */
+#define MM_SNAP_CLASSES 128
+
+typedef struct {
+    size_t heap;                     /* heap bytes */
+    size_t free;                     /* bytes in free blocks */
+    size_t nfree;                    /* free blocks */
+    size_t largest;                  /* bytes in the largest free block */
+    size_t cached;                   /* bytes in this thread's cache and
+                                        the quick lists */
+    size_t slab_free;                /* bytes of free slab objects */
+    size_t count[MM_SNAP_CLASSES];   /* free blocks in each class... */
+    size_t bytes[MM_SNAP_CLASSES];   /* ...and their bytes */
+} mm_snap_t;
+
+extern void mm_snapshot(mm_snap_t *snap) __attribute__((weak));
+
+/*
+ * Placement policies, for mdriver -A; only mm.c has them. They decide
+ * which free block of a size class a request gets: the most recently
+ * freed one that fits (LIFO, the default), the lowest-addressed one
+ * (ADDRESS), the smallest of the first k that fit (BESTFIT), or the
+ * next one after the last block taken (NEXTFIT). Free blocks of RB_MIN
+ * bytes (32 KB by default) or more are kept in a tree instead and are
+ * always placed best fit, whatever the policy. mm_set_policy takes effect at the next
+ * mm_init and returns -1 for an unknown policy.
+ */
+enum {MM_LIFO, MM_ADDRESS, MM_BESTFIT, MM_NEXTFIT, MM_POLICIES};
+
+extern int mm_set_policy(int policy, int k) __attribute__((weak));
+
+/*
+ * Compile-time variants, for mdriver -K; only mdriver-variants, which
+ * links several builds of mm.c through mmvariants.c, has them.
+ * mm_variant_name returns the name of variant v (NULL past the last),
+ * and mm_set_variant makes the mm_* calls go to variant v from then
+ * on, returning -1 if there is no such variant.
+ */
+extern char *mm_variant_name(int v) __attribute__((weak));
+extern int mm_set_variant(int v) __attribute__((weak));
+
 
 /* 
  * Students work in teams of one or two.  Teams enter their team name, 
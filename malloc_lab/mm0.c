@@ -35,11 +35,11 @@ team_t team = {
     ""
 };
 
-/* single word (4) or double word (8) alignment */
-#define ALIGNMENT 8
+/* 16-byte alignment, as checked by the driver */
+#define ALIGNMENT 16
 
 /* rounds up to the nearest multiple of ALIGNMENT */
-#define ALIGN(size) (((size) + (ALIGNMENT-1)) & ~0x7)
+#define ALIGN(size) (((size) + (ALIGNMENT-1)) & ~(ALIGNMENT-1))
 
 
 #define SIZE_T_SIZE (ALIGN(sizeof(size_t)))
@@ -95,6 +95,30 @@ void *mm_realloc(void *ptr, size_t size)
     return newptr;
 }
 
+/*
+ * mm_malloc_batch - Allocate n blocks of size bytes, one at a time
+ */
+int mm_malloc_batch(size_t size, int n, void **out)
+{
+    int i;
+
+    for (i = 0; i < n; i++)
+	if ((out[i] = mm_malloc(size)) == NULL)
+	    break;
+    return i;
+}
+
+/*
+ * mm_free_batch - Free n blocks, one at a time
+ */
+void mm_free_batch(void **ptrs, int n)
+{
+    int i;
+
+    for (i = 0; i < n; i++)
+	mm_free(ptrs[i]);
+}
+
 
 
 
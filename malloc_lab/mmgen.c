@@ -0,0 +1,514 @@
+/*
+ * mmgen.c - Generate synthetic mdriver traces from parametric models of
+ *           a program's allocations, at any scale.
+ *
+ * usage: mmgen [-n <ops>] [-s <dist>] [-l <dist>] [-p <len>:<share>]
+ *              [-r <prob>:<factor>:<max>] [-m <bytes>] [-S <seed>] [-t]
+ *              <out>
+ *
+ *   -n <ops>    Ops in the trace, frees included (K, M, G suffixes
+ *               are powers of ten). Default 1M.
+ *   -s <dist>   Request sizes in bytes. Default power:1.2:16:64K.
+ *   -l <dist>   Lifetimes, in ops from the alloc to its free.
+ *               Default exp:1000.
+ *   -p <len>:<share>
+ *               Producer/consumer phases of len ops each. In producer
+ *               phases, share of the allocs are queued instead of
+ *               getting a lifetime; in consumer phases, share of the
+ *               ops free the oldest queued block. Default off.
+ *   -r <prob>:<factor>:<max>
+ *               Realloc growth: each op is, with probability prob, a
+ *               realloc of a random live block to factor times its
+ *               size, as a growing buffer would be, up to max times
+ *               per block. Default off.
+ *   -m <bytes>  Cap on the live (requested) bytes: an alloc that would
+ *               pass it frees the block due to die first. K, M, G
+ *               suffixes are powers of two. Default none.
+ *   -S <seed>   Seed of the random number generator. Default 1.
+ *   -t          Write a .rep text trace instead of a binary trace.
+ *
+ * A distribution <dist> is one of
+ *
+ *   fixed:<n>                        always n
+ *   uniform:<lo>:<hi>                lo..hi, evenly
+ *   power:<alpha>:<lo>:<hi>          Pareto, truncated to lo..hi: most
+ *                                    values near lo, a heavy tail
+ *   bimodal:<p>:<lo1>:<hi1>:<lo2>:<hi2>
+ *                                    lo1..hi1 with probability p, else
+ *                                    lo2..hi2
+ *   exp:<mean>                       exponential
+ *
+ * where byte counts may carry K, M or G suffixes. Every block is freed
+ * by the end of the trace (bar the lone alloc of -n 1), which is
+ * exactly <ops> long, and the ids of freed blocks are reused, so
+ * num_ids is the most blocks ever live at once. Binary traces (see
+ * trace.h) are far quicker for mdriver to load than .rep files at
+ * hundreds of millions of ops. To run one whose heap outgrows
+ * MAX_HEAP, give mdriver -M:
+ *
+ *   unix> mmgen -n 200M -s bimodal:0.9:16:256:4K:1M -m 2G big.bin
+ *   unix> mdriver -M 3G -f big.bin
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+#include <math.h>
+
+#include "trace.h"
+
+enum {FIXED, UNIFORM, POWER, BIMODAL, EXP};
+
+/* A distribution and its parameters, as in the syntax above */
+typedef struct {
+    int kind;
+    double p[5];
+} dist_t;
+
+/* A block due to be freed at op time t, in the death heap */
+typedef struct {
+    long t;
+    int id;
+} death_t;
+
+/* What the generator knows about each id */
+typedef struct {
+    unsigned int size;   /* bytes requested */
+    int grows;           /* reallocs so far */
+    int gpos;            /* its place in growing[], or -1 */
+} block_t;
+
+static block_t *blocks;       /* indexed by id */
+static int num_ids;           /* ids ever used */
+static int *free_ids, nfree_ids;
+static death_t *deaths;       /* min-heap on t */
+static int ndeaths;
+static int *queue;            /* producer/consumer FIFO, a ring... */
+static long qhead, qtail;     /* ...read at qhead, written at qtail */
+static int qcap;
+static int *growing;          /* live blocks that may still grow */
+static int ngrowing;
+static int cap_ids;           /* room in all the per-id arrays */
+
+static long live_bytes, peak_bytes;
+static long nops, nallocs, nfrees, nreallocs;
+
+static FILE *out;
+static int text;
+
+static unsigned long long rng_state;
+
+static void die(char *msg, char *arg)
+{
+    fprintf(stderr, "mmgen: %s %s\n", msg, arg);
+    exit(1);
+}
+
+/* uniform - xorshift64*, as a double in [0, 1) */
+static double uniform(void)
+{
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return ((rng_state * 2685821657736338717ULL) >> 11) * (1.0 / (1ULL << 53));
+}
+
+static double draw(dist_t *d)
+{
+    double u = uniform(), lo, hi;
+
+    switch (d->kind) {
+    case FIXED:
+	return d->p[0];
+    case UNIFORM:
+	return floor(d->p[0] + u * (d->p[1] - d->p[0] + 1));
+    case POWER:  /* inverse of the truncated Pareto distribution */
+	lo = d->p[1];
+	hi = d->p[2];
+	return floor(lo / pow(1 - u * (1 - pow(lo / hi, d->p[0])),
+			      1 / d->p[0]));
+    case BIMODAL:
+	if (uniform() < d->p[0])
+	    return floor(d->p[1] + u * (d->p[2] - d->p[1] + 1));
+	return floor(d->p[3] + u * (d->p[4] - d->p[3] + 1));
+    default:     /* EXP */
+	return floor(-d->p[0] * log(1 - u));
+    }
+}
+
+/*
+ * number - A number with an optional K, M or G suffix, in powers of
+ *     two if binary is set, else of ten
+ */
+static double number(char *s, char **end, int binary)
+{
+    double n = strtod(s, end), k = binary ? 1024 : 1000;
+
+    switch (**end) {
+    case 'K': case 'k': n *= k; (*end)++; break;
+    case 'M': case 'm': n *= k*k; (*end)++; break;
+    case 'G': case 'g': n *= k*k*k; (*end)++; break;
+    }
+    return n;
+}
+
+/*
+ * parse_list - Parse the numbers of "a:b:c" into v[], and return how
+ *     many there were, or -1 if there is junk
+ */
+static int parse_list(char *s, double *v, int max)
+{
+    int n = 0;
+    char *end;
+
+    while (n < max) {
+	v[n++] = number(s, &end, 1);
+	if (end == s || (*end != ':' && *end != '\0'))
+	    return -1;
+	if (*end == '\0')
+	    return n;
+	s = end + 1;
+    }
+    return -1;
+}
+
+static void parse_dist(char *s, dist_t *d)
+{
+    static struct {
+	char *name;
+	int kind, nparams;
+    } kinds[] = {
+	{"fixed", FIXED, 1}, {"uniform", UNIFORM, 2}, {"power", POWER, 3},
+	{"bimodal", BIMODAL, 5}, {"exp", EXP, 1}
+    };
+    char *colon = strchr(s, ':');
+    int i, len = colon ? colon - s : (int)strlen(s);
+
+    for (i = 0; i < 5; i++)
+	if ((int)strlen(kinds[i].name) == len && !strncmp(s, kinds[i].name, len))
+	    break;
+    if (i == 5 || colon == NULL ||
+	parse_list(colon + 1, d->p, 5) != kinds[i].nparams)
+	die("bad distribution", s);
+    d->kind = kinds[i].kind;
+    if ((d->kind == UNIFORM && d->p[1] < d->p[0]) ||
+	(d->kind == POWER && (d->p[0] <= 0 || d->p[1] < 1 || d->p[2] < d->p[1])) ||
+	(d->kind == BIMODAL && (d->p[2] < d->p[1] || d->p[4] < d->p[3])))
+	die("bad distribution", s);
+}
+
+/*
+ * emit - Write one op, and count it
+ */
+static void emit(int type, int id, unsigned int size)
+{
+    traceop_t op;
+
+    if (text) {
+	if (type == FREE)
+	    fprintf(out, "f %d\n", id);
+	else
+	    fprintf(out, "%c %d %u\n", type == ALLOC ? 'a' : 'r', id, size);
+    } else {
+	op.type = type;
+	op.index = id;
+	op.size = size;
+	fwrite(&op, sizeof(op), 1, out);
+    }
+    nops++;
+}
+
+/*
+ * write_header - Write the trace header, at the start of the file and
+ *     again, with the final numbers, at the end. The .rep header is
+ *     padded to a fixed width so that it can be rewritten in place.
+ */
+static void write_header(void)
+{
+    bintrace_hdr_t hdr;
+    int heap = peak_bytes > INT_MAX ? INT_MAX : (int)peak_bytes;
+
+    rewind(out);
+    if (text) {
+	fprintf(out, "%12d\n%12d\n%12ld\n%12d\n", heap, num_ids, nops, 1);
+	return;
+    }
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, BINTRACE_MAGIC, 4);
+    hdr.version = BINTRACE_VERSION;
+    hdr.sugg_heapsize = heap;
+    hdr.num_ids = num_ids;
+    hdr.num_ops = (int)nops;
+    hdr.weight = 1;
+    fwrite(&hdr, sizeof(hdr), 1, out);
+}
+
+/*
+ * new_id - An id for a new block: a freed one if there is one
+ */
+static int new_id(void)
+{
+    if (nfree_ids > 0)
+	return free_ids[--nfree_ids];
+    if (num_ids == cap_ids) {
+	cap_ids = cap_ids ? 2 * cap_ids : 1024;
+	blocks = realloc(blocks, cap_ids * sizeof(block_t));
+	free_ids = realloc(free_ids, cap_ids * sizeof(int));
+	deaths = realloc(deaths, cap_ids * sizeof(death_t));
+	growing = realloc(growing, cap_ids * sizeof(int));
+	if (!blocks || !free_ids || !deaths || !growing)
+	    die("out of memory at", "new_id");
+    }
+    return num_ids++;
+}
+
+/* The death heap, ordered on t */
+static void death_push(long t, int id)
+{
+    int i = ndeaths++, parent;
+
+    while (i > 0 && deaths[parent = (i - 1) / 2].t > t) {
+	deaths[i] = deaths[parent];
+	i = parent;
+    }
+    deaths[i].t = t;
+    deaths[i].id = id;
+}
+
+static int death_pop(void)
+{
+    int id = deaths[0].id, i = 0, child;
+    death_t last = deaths[--ndeaths];
+
+    while ((child = 2*i + 1) < ndeaths) {
+	if (child + 1 < ndeaths && deaths[child + 1].t < deaths[child].t)
+	    child++;
+	if (last.t <= deaths[child].t)
+	    break;
+	deaths[i] = deaths[child];
+	i = child;
+    }
+    deaths[i] = last;
+    return id;
+}
+
+/* The producer/consumer queue */
+static void queue_push(int id)
+{
+    int *q;
+    long i;
+
+    if (qtail - qhead == qcap) {
+	if ((q = malloc((qcap ? 2 * qcap : 1024) * sizeof(int))) == NULL)
+	    die("out of memory at", "queue_push");
+	for (i = qhead; i < qtail; i++)
+	    q[i - qhead] = queue[i % qcap];
+	free(queue);
+	queue = q;
+	qtail -= qhead;
+	qhead = 0;
+	qcap = qcap ? 2 * qcap : 1024;
+    }
+    queue[qtail++ % qcap] = id;
+}
+
+static void allocate(unsigned int size, long t, dist_t *life, int queued,
+		     int grow)
+{
+    int id = new_id();
+
+    blocks[id].size = size;
+    blocks[id].grows = 0;
+    blocks[id].gpos = -1;
+    if (grow) {
+	blocks[id].gpos = ngrowing;
+	growing[ngrowing++] = id;
+    }
+    if (queued)
+	queue_push(id);
+    else
+	death_push(t + 1 + (long)draw(life), id);
+    live_bytes += size;
+    if (live_bytes > peak_bytes)
+	peak_bytes = live_bytes;
+    nallocs++;
+    emit(ALLOC, id, size);
+}
+
+static void unlink_growing(int id)
+{
+    int pos = blocks[id].gpos;
+
+    if (pos < 0)
+	return;
+    growing[pos] = growing[--ngrowing];
+    blocks[growing[pos]].gpos = pos;
+    blocks[id].gpos = -1;
+}
+
+static void release(int id)
+{
+    unlink_growing(id);
+    live_bytes -= blocks[id].size;
+    free_ids[nfree_ids++] = id;
+    nfrees++;
+    emit(FREE, id, 0);
+}
+
+/*
+ * grow - Realloc a random growing block to factor times its size. A
+ *     block that would pass INT_MAX bytes, or take the live bytes past
+ *     cap (if not 0), stops growing instead.
+ */
+static void grow(double factor, int max, double cap)
+{
+    int id = growing[(int)(uniform() * ngrowing)];
+    double size = ceil(blocks[id].size * factor);
+
+    if (size > INT_MAX ||
+	(cap && live_bytes + size - blocks[id].size > cap)) {
+	unlink_growing(id);
+	return;
+    }
+    live_bytes += (long)size - blocks[id].size;
+    if (live_bytes > peak_bytes)
+	peak_bytes = live_bytes;
+    blocks[id].size = (unsigned int)size;
+    if (++blocks[id].grows >= max)
+	unlink_growing(id);
+    nreallocs++;
+    emit(REALLOC, id, blocks[id].size);
+}
+
+int main(int argc, char **argv)
+{
+    dist_t size_dist, life_dist;
+    double v[5], total = 1e6, cap = 0, share = 0, rprob = 0, rfactor = 2;
+    long phase = 0, t, live;
+    int c, id, rmax = 0, consumer;
+    double size;
+    char *end;
+
+    parse_dist("power:1.2:16:64K", &size_dist);
+    parse_dist("exp:1000", &life_dist);
+    rng_state = 1;
+
+    while ((c = getopt(argc, argv, "n:s:l:p:r:m:S:t")) != EOF) {
+	switch (c) {
+	case 'n':
+	    total = number(optarg, &end, 0);
+	    if (*end || total < 1 || total > INT_MAX)
+		die("bad op count", optarg);
+	    break;
+	case 's':
+	    parse_dist(optarg, &size_dist);
+	    break;
+	case 'l':
+	    parse_dist(optarg, &life_dist);
+	    break;
+	case 'p':
+	    if (parse_list(optarg, v, 2) != 2 || v[0] < 1 || v[1] < 0 || v[1] > 1)
+		die("bad phases", optarg);
+	    phase = (long)v[0];
+	    share = v[1];
+	    break;
+	case 'r':
+	    if (parse_list(optarg, v, 3) != 3 || v[0] < 0 || v[0] >= 1 ||
+		v[1] <= 1 || v[2] < 1)
+		die("bad realloc growth", optarg);
+	    rprob = v[0];
+	    rfactor = v[1];
+	    rmax = (int)v[2];
+	    break;
+	case 'm':
+	    cap = number(optarg, &end, 1);
+	    if (*end || cap < 1)
+		die("bad byte count", optarg);
+	    break;
+	case 'S':
+	    rng_state = strtoull(optarg, NULL, 0) | 1;
+	    break;
+	case 't':
+	    text = 1;
+	    break;
+	default:
+	    optind = argc;
+	}
+    }
+    if (optind != argc - 1) {
+	fprintf(stderr, "usage: mmgen [-n <ops>] [-s <dist>] [-l <dist>] "
+		"[-p <len>:<share>]\n             [-r <prob>:<factor>:<max>] "
+		"[-m <bytes>] [-S <seed>] [-t] <out>\n");
+	exit(1);
+    }
+    if ((out = fopen(argv[optind], "wb")) == NULL)
+	die("could not create", argv[optind]);
+    write_header();
+
+    /* Leave just enough ops to free every block still live. An alloc
+       takes two ops, so if one is left over it goes to a realloc that
+       keeps a block's size. */
+    for (t = 0; (live = num_ids - nfree_ids) + nops < (long)total; t++) {
+	consumer = phase && (t / phase) % 2;
+
+	if (live + nops + 1 == (long)total) {
+	    if (live > 0) {
+		id = ndeaths > 0 ? deaths[0].id : queue[qhead % qcap];
+		nreallocs++;
+		emit(REALLOC, id, blocks[id].size);
+	    } else {
+		/* Only with -n 1: an alloc there is no room to free */
+		size = draw(&size_dist);
+		size = size < 1 ? 1 : size > INT_MAX ? INT_MAX : size;
+		if (cap && size > cap)
+		    size = cap;
+		peak_bytes = (long)size;
+		nallocs++;
+		emit(ALLOC, new_id(), (unsigned int)size);
+	    }
+	    break;
+	}
+
+	if (ndeaths > 0 && deaths[0].t <= nops) {
+	    release(death_pop());
+	    continue;
+	}
+	if (consumer && qtail > qhead && uniform() < share) {
+	    release(queue[qhead++ % qcap]);
+	    continue;
+	}
+	if (ngrowing > 0 && uniform() < rprob) {
+	    grow(rfactor, rmax, cap);
+	    continue;
+	}
+
+	size = draw(&size_dist);
+	size = size < 1 ? 1 : size > INT_MAX ? INT_MAX : size;
+	if (cap && live_bytes + size > cap) {
+	    if (ndeaths > 0) {
+		release(death_pop());
+		continue;
+	    }
+	    if (qtail > qhead) {
+		release(queue[qhead++ % qcap]);
+		continue;
+	    }
+	    size = cap - live_bytes;   /* nothing to free: fill up to cap */
+	}
+	allocate((unsigned int)size, nops, &life_dist,
+		 phase && !consumer && uniform() < share, rprob > 0);
+    }
+    while (ndeaths > 0)
+	release(death_pop());
+    while (qtail > qhead)
+	release(queue[qhead++ % qcap]);
+
+    write_header();
+    if (fclose(out) != 0)
+	die("could not write", argv[optind]);
+    printf("%ld ops (%ld allocs, %ld reallocs, %ld frees), %d ids, "
+	   "peak %.1f MB live\n", nops, nallocs, nreallocs, nfrees, num_ids,
+	   peak_bytes / 1048576.0);
+    return 0;
+}
@@ -0,0 +1,348 @@
+/*
+ * mmshim.c - Run the mm.c package as the system allocator.
+ *
+ *   unix> make mmshim.so
+ *   unix> LD_PRELOAD=./mmshim.so sort big.txt > /dev/null
+ *
+ * The shim defines malloc, free, realloc, calloc, the aligned variants
+ * and malloc_usable_size on top of mm_malloc, mm_free and mm_realloc,
+ * which are already thread-safe. It also takes the place of memlib.c:
+ * mem_sbrk moves the real program break with sbrk, and mem_mmap makes
+ * real anonymous mappings, so the package runs on the process's own
+ * memory instead of memlib's simulated heap. The package is set up by
+ * mm_init on the first call.
+ *
+ * mm.c keeps 32-bit offsets into its heap, so the heap is limited to
+ * HEAP_MAX bytes; larger blocks come from mappings anyway. The heap
+ * starts at a HEAP_ALIGN boundary, which is the largest alignment
+ * posix_memalign and friends can provide.
+ *
+ * mem_munmap and mem_mremap are only given the address of a mapping,
+ * so each mapping starts with a page that records its length.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+
+#include "mm.h"
+#include "memlib.h"
+
+#define HEAP_MAX    ((size_t)1 << 32)   /* most heap bytes mm.c can address */
+#define HEAP_ALIGN  ((size_t)1 << 20)   /* alignment of the heap start */
+#define MAX_REQUEST (SIZE_MAX / 2)      /* larger requests fail at once */
+
+/* Everything outside the malloc interface stays private to the shim */
+#define EXPORT __attribute__((visibility("default")))
+
+/* The heap, a contiguous range of the real data segment */
+static char *mem_start_brk;  /* first byte of heap */
+static char *mem_brk;        /* one past the last byte of heap */
+static size_t mem_mapped;    /* bytes in all live mappings */
+static size_t mem_peak;      /* largest footprint so far */
+static size_t mem_page;      /* system page size */
+
+static pthread_once_t shim_once = PTHREAD_ONCE_INIT;
+static volatile int shim_ready;
+
+static void mem_update_peak(void);
+
+/*
+ * mem_init - Align the program break to HEAP_ALIGN; the heap grows
+ *    from there. The padding is never touched, so it costs no memory.
+ */
+void mem_init(void)
+{
+    char *brk;
+    size_t pad;
+
+    mem_page = (size_t)getpagesize();
+    if ((brk = sbrk(0)) == (void *)-1)
+	return;
+    pad = (HEAP_ALIGN - (uintptr_t)brk % HEAP_ALIGN) % HEAP_ALIGN;
+    if (pad && sbrk(pad) == (void *)-1)
+	return;
+    mem_start_brk = mem_brk = brk + pad;
+}
+
+/*
+ * mem_deinit - Give the whole heap back to the system
+ */
+void mem_deinit(void)
+{
+    mem_reset_brk();
+}
+
+/*
+ * mem_reset_brk - Shrink the heap to nothing. Mappings are left alone;
+ *    the shim does not track them.
+ */
+void mem_reset_brk(void)
+{
+    if (mem_brk != mem_start_brk && sbrk(mem_start_brk - mem_brk) != (void *)-1)
+	mem_brk = mem_start_brk;
+}
+
+/*
+ * mem_sbrk - Move the real program break by incr bytes and return the
+ *    old break, like sbrk. Fails with (void *)-1 if the heap would pass
+ *    HEAP_MAX, shrink below its start, or stop being contiguous
+ *    because something else moved the break.
+ */
+void *mem_sbrk(intptr_t incr)
+{
+    char *old_brk = mem_brk;
+
+    if (mem_start_brk == NULL ||
+	(incr < 0 && (mem_brk - mem_start_brk) < -incr) ||
+	(incr > 0 && (size_t)(mem_brk - mem_start_brk) + incr > HEAP_MAX)) {
+	errno = ENOMEM;
+	return (void *)-1;
+    }
+    if (sbrk(0) != mem_brk || sbrk(incr) != mem_brk) {
+	errno = ENOMEM;
+	return (void *)-1;
+    }
+    mem_brk += incr;
+    mem_update_peak();
+    return old_brk;
+}
+
+/*
+ * mem_mmap - Map len bytes (a multiple of the page size) outside the
+ *    heap, behind a page holding the length. Returns their address, or
+ *    (void *)-1 if it fails.
+ */
+void *mem_mmap(size_t len)
+{
+    char *p;
+
+    p = mmap(NULL, len + mem_page, PROT_READ|PROT_WRITE,
+	     MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED)
+	return (void *)-1;
+    *(size_t *)p = len;
+    mem_mapped += len;
+    mem_update_peak();
+    return p + mem_page;
+}
+
+/*
+ * mem_munmap - Unmap the whole mapping at addr made by mem_mmap
+ */
+int mem_munmap(void *addr)
+{
+    char *p = (char *)addr - mem_page;
+    size_t len = *(size_t *)p;
+
+    mem_mapped -= len;
+    return munmap(p, len + mem_page);
+}
+
+/*
+ * mem_mremap - Resize the mapping at addr to len bytes, moving it
+ *    (without copying) if it cannot grow where it is. Returns its new
+ *    address, or (void *)-1 if it fails.
+ */
+void *mem_mremap(void *addr, size_t len)
+{
+    char *p = (char *)addr - mem_page;
+    size_t old = *(size_t *)p;
+
+    if ((p = mremap(p, old + mem_page, len + mem_page, MREMAP_MAYMOVE)) == MAP_FAILED)
+	return (void *)-1;
+    *(size_t *)p = len;
+    mem_mapped += len - old;
+    mem_update_peak();
+    return p + mem_page;
+}
+
+/*
+ * mem_is_mapped - returns true if the bytes lo..hi are all mapped;
+ *    msync fails with ENOMEM on any page that is not
+ */
+int mem_is_mapped(void *lo, void *hi)
+{
+    char *start = (char *)((uintptr_t)lo & ~(mem_page - 1));
+
+    return msync(start, (char *)hi + 1 - start, MS_ASYNC) == 0;
+}
+
+static void mem_update_peak(void)
+{
+    if (mem_footprint() > mem_peak)
+	mem_peak = mem_footprint();
+}
+
+void *mem_heap_lo(void)
+{
+    return mem_start_brk;
+}
+
+void *mem_heap_hi(void)
+{
+    return mem_brk - 1;
+}
+
+size_t mem_heapsize(void)
+{
+    return (size_t)(mem_brk - mem_start_brk);
+}
+
+size_t mem_mapsize(void)
+{
+    return mem_mapped;
+}
+
+size_t mem_footprint(void)
+{
+    return mem_heapsize() + mem_mapped;
+}
+
+size_t mem_peak_footprint(void)
+{
+    return mem_peak;
+}
+
+size_t mem_pagesize(void)
+{
+    return mem_page;
+}
+
+/*
+ * shim_init - Set up the heap and the package, once per process
+ */
+static void shim_init(void)
+{
+    mem_init();
+    if (mm_init() < 0) {
+	fprintf(stderr, "mmshim: mm_init failed\n");
+	abort();
+    }
+    shim_ready = 1;
+}
+
+static inline void shim_start(void)
+{
+    if (!shim_ready)
+	pthread_once(&shim_once, shim_init);
+}
+
+/*
+ * The malloc interface. mm_malloc turns down zero-byte requests, which
+ * programs expect to succeed, so those get the smallest block instead.
+ */
+EXPORT void *malloc(size_t size)
+{
+    void *p;
+
+    if (size > MAX_REQUEST) {
+	errno = ENOMEM;
+	return NULL;
+    }
+    shim_start();
+    if ((p = mm_malloc(size ? size : 1)) == NULL)
+	errno = ENOMEM;
+    return p;
+}
+
+EXPORT void free(void *ptr)
+{
+    if (ptr != NULL)
+	mm_free(ptr);
+}
+
+/* Not malloc then memset: the compiler would fold that back into a
+   call to calloc */
+EXPORT void *calloc(size_t n, size_t size)
+{
+    size_t total = n * size;
+    void *p;
+
+    if (size && n > MAX_REQUEST / size) {
+	errno = ENOMEM;
+	return NULL;
+    }
+    shim_start();
+    if ((p = mm_malloc(total ? total : 1)) == NULL)
+	errno = ENOMEM;
+    else
+	memset(p, 0, total);
+    return p;
+}
+
+/* A failed realloc leaves ptr allocated; realloc(ptr, 0) frees it */
+EXPORT void *realloc(void *ptr, size_t size)
+{
+    void *p;
+
+    if (ptr == NULL)
+	return malloc(size);
+    if (size > MAX_REQUEST) {
+	errno = ENOMEM;
+	return NULL;
+    }
+    if ((p = mm_realloc(ptr, size)) == NULL && size)
+	errno = ENOMEM;
+    return p;
+}
+
+EXPORT void *reallocarray(void *ptr, size_t n, size_t size)
+{
+    if (size && n > MAX_REQUEST / size) {
+	errno = ENOMEM;
+	return NULL;
+    }
+    return realloc(ptr, n * size);
+}
+
+EXPORT void *memalign(size_t align, size_t size)
+{
+    void *p;
+
+    if (align & (align - 1)) {
+	errno = EINVAL;
+	return NULL;
+    }
+    if (size > MAX_REQUEST) {
+	errno = ENOMEM;
+	return NULL;
+    }
+    shim_start();
+    if ((p = mm_memalign(align, size ? size : 1)) == NULL)
+	errno = ENOMEM;
+    return p;
+}
+
+EXPORT int posix_memalign(void **pp, size_t align, size_t size)
+{
+    void *p;
+
+    if (align < sizeof(void *) || (align & (align - 1)))
+	return EINVAL;
+    if ((p = memalign(align, size)) == NULL)
+	return ENOMEM;
+    *pp = p;
+    return 0;
+}
+
+EXPORT void *aligned_alloc(size_t align, size_t size)
+{
+    return memalign(align, size);
+}
+
+EXPORT void *valloc(size_t size)
+{
+    shim_start();
+    return memalign(mem_page, size);
+}
+
+EXPORT size_t malloc_usable_size(void *ptr)
+{
+    return mm_usable_size(ptr);
+}
@@ -0,0 +1,581 @@
+/*
+ * mmtrace.c - LD_PRELOAD malloc interposer that records a process's
+ *             allocation calls as an mdriver trace.
+ *
+ *   unix> make mmtrace.so
+ *   unix> LD_PRELOAD=./mmtrace.so MMTRACE_FILE=ls.rep ls -l
+ *   unix> mdriver -M 1G -f ls.rep
+ *
+ * Traces of real programs usually need more than the default 20 MB
+ * heap (MAX_HEAP), hence the -M to let it grow.
+ *
+ * malloc, calloc, realloc, free and the aligned variants are passed on
+ * to the real allocator; each call is also appended to a ring buffer
+ * owned by the calling thread. Only that thread writes its ring and
+ * only the flusher reads it, so recording takes no lock: the two sides
+ * meet at the head and tail indices. flush_lock is only taken to add a
+ * thread's ring, to flush, and, when the thread exits, to flush what
+ * is left in its ring before unmapping it. Every record carries a
+ * global sequence number, taken after the real call for allocations
+ * and before it for frees, so that the flusher can merge the rings
+ * back into the order in which addresses were handed out and back.
+ *
+ * The flusher maps each live address to a small id (ids of freed
+ * blocks are reused) and writes the records in .rep form to
+ * MMTRACE_FILE (default mmtrace.<pid>.rep). The header, which needs
+ * the final counts, is rewritten when the process exits.
+ *
+ * Zero-byte requests, and frees of blocks allocated before tracing
+ * began, are left out, since mdriver cannot replay them. A child
+ * process made by fork is not traced.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <dlfcn.h>
+#include <sched.h>
+#include <pthread.h>
+#include <sys/mman.h>
+
+#define RING_SIZE   (1 << 14)  /* records per thread ring, a power of two */
+#define FLUSH_USECS 1000       /* flusher sleep between passes */
+#define MAX_STALL   100        /* passes to wait for a missing seq number */
+#define BOOT_SIZE   (1 << 16)  /* bytes for allocations during dlsym */
+
+/* A recorded call */
+typedef struct {
+    unsigned long seq;   /* global order of the call */
+    void *ptr;           /* block allocated, or freed for a FREE */
+    void *old;           /* block a REALLOC replaced, or NULL */
+    size_t size;         /* bytes requested */
+    int type;            /* 'a', 'r' or 'f' */
+} rec_t;
+
+/* One thread's ring: the thread bumps head, the flusher bumps tail */
+typedef struct ring {
+    unsigned long head;
+    unsigned long tail;
+    struct ring *next;   /* all rings, newest first */
+    rec_t recs[RING_SIZE];
+} ring_t;
+
+/* The real allocator */
+static void *(*real_malloc)(size_t);
+static void *(*real_calloc)(size_t, size_t);
+static void *(*real_realloc)(void *, size_t);
+static void (*real_free)(void *);
+static int (*real_posix_memalign)(void **, size_t, size_t);
+static void *(*real_memalign)(size_t, size_t);
+static void *(*real_aligned_alloc)(size_t, size_t);
+
+/* Allocations made while dlsym looks up the real allocator */
+static char boot_buf[BOOT_SIZE] __attribute__((aligned(16)));
+static size_t boot_used;
+#define MIN(x, y)  ((x) < (y) ? (x) : (y))
+#define IS_BOOT(p) ((char *)(p) >= boot_buf && (char *)(p) < boot_buf + BOOT_SIZE)
+
+static ring_t *rings;                 /* every thread's ring */
+static unsigned long next_seq;        /* next sequence number to hand out */
+static volatile int tracing;          /* set while calls are recorded */
+static volatile int stopping;         /* tells the flusher to finish */
+static pthread_t flusher;
+static pthread_key_t ring_key;        /* unmaps a thread's ring at exit */
+
+/* flush_lock guards the rings list and the flusher state below */
+static pthread_mutex_t flush_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static __thread ring_t *my_ring __attribute__((tls_model("initial-exec")));
+static __thread int in_hook __attribute__((tls_model("initial-exec")));
+
+/* Flusher state: the output file, address-to-id map and counts */
+static FILE *out;
+static unsigned long done_seq;        /* all records below it written */
+static void **id_addr;                /* hash table of live addresses... */
+static int *id_of;                    /* ...and their ids */
+static size_t id_cap, id_live;        /* table size (power of 2), entries */
+static int *free_ids, nfree_ids, num_ids;
+static long num_ops;
+static size_t live_bytes, peak_bytes;
+static size_t *id_size;               /* bytes requested for each id */
+static int id_size_cap;
+
+static void init(void) __attribute__((constructor));
+static void fini(void) __attribute__((destructor));
+
+/*
+ * lookup - Look up the real allocator, serving the allocations dlsym
+ *     itself makes from boot_buf
+ */
+static void lookup(void)
+{
+    static int looking;
+
+    if (real_malloc || looking)
+	return;
+    looking = 1;
+    real_calloc = dlsym(RTLD_NEXT, "calloc");
+    real_realloc = dlsym(RTLD_NEXT, "realloc");
+    real_free = dlsym(RTLD_NEXT, "free");
+    real_posix_memalign = dlsym(RTLD_NEXT, "posix_memalign");
+    real_memalign = dlsym(RTLD_NEXT, "memalign");
+    real_aligned_alloc = dlsym(RTLD_NEXT, "aligned_alloc");
+    real_malloc = dlsym(RTLD_NEXT, "malloc");
+    looking = 0;
+}
+
+static void *boot_alloc(size_t size)
+{
+    void *p;
+
+    size = (size + 15) & ~(size_t)15;
+    if (boot_used + size > BOOT_SIZE)
+	return NULL;
+    p = boot_buf + boot_used;
+    boot_used += size;
+    return p;
+}
+
+/*
+ * record - Append a call to the calling thread's ring, waiting for
+ *     the flusher if the ring is full
+ */
+static void record(int type, void *ptr, void *old, size_t size)
+{
+    ring_t *r = my_ring;
+    rec_t *rec;
+    unsigned long h;
+
+    if (r == NULL) {
+	r = mmap(NULL, sizeof(ring_t), PROT_READ|PROT_WRITE,
+		 MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+	if (r == MAP_FAILED)
+	    return;
+	pthread_mutex_lock(&flush_lock);
+	r->next = rings;
+	__atomic_store_n(&rings, r, __ATOMIC_RELEASE);
+	pthread_mutex_unlock(&flush_lock);
+	pthread_setspecific(ring_key, r);
+	my_ring = r;
+    }
+
+    h = r->head;
+    while (h - __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE) == RING_SIZE)
+	sched_yield();
+    rec = &r->recs[h & (RING_SIZE - 1)];
+    rec->seq = __atomic_fetch_add(&next_seq, 1, __ATOMIC_RELAXED);
+    rec->type = type;
+    rec->ptr = ptr;
+    rec->old = old;
+    rec->size = size;
+    __atomic_store_n(&r->head, h + 1, __ATOMIC_RELEASE);
+}
+
+/*
+ * The interposed allocator. A call is recorded only when tracing and
+ * not already inside a hook (the flusher and our own helpers call
+ * malloc too).
+ */
+#define TRACED()  (tracing && !in_hook)
+
+void *malloc(size_t size)
+{
+    void *p;
+
+    lookup();
+    if (real_malloc == NULL)
+	return boot_alloc(size);
+    p = real_malloc(size);
+    if (p && size && TRACED()) {
+	in_hook = 1;
+	record('a', p, NULL, size);
+	in_hook = 0;
+    }
+    return p;
+}
+
+void *calloc(size_t n, size_t size)
+{
+    void *p;
+
+    lookup();
+    if (real_calloc == NULL)
+	return boot_alloc(n * size);   /* boot_buf is zeroed */
+    p = real_calloc(n, size);
+    if (p && n && size && TRACED()) {
+	in_hook = 1;
+	record('a', p, NULL, n * size);
+	in_hook = 0;
+    }
+    return p;
+}
+
+void free(void *ptr)
+{
+    if (ptr == NULL || IS_BOOT(ptr))
+	return;
+    lookup();
+    if (real_free == NULL)
+	return;
+    if (TRACED()) {
+	in_hook = 1;
+	record('f', ptr, NULL, 0);
+	in_hook = 0;
+    }
+    real_free(ptr);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+    void *p;
+
+    lookup();
+    if (ptr && IS_BOOT(ptr)) {         /* move out of boot_buf */
+	if ((p = malloc(size)) != NULL)
+	    memcpy(p, ptr, MIN(size, (size_t)(boot_buf + BOOT_SIZE - (char *)ptr)));
+	return p;
+    }
+    if (real_realloc == NULL)
+	return boot_alloc(size);
+    if (ptr && size == 0) {
+	free(ptr);
+	return NULL;
+    }
+    p = real_realloc(ptr, size);
+    if (p && size && TRACED()) {
+	in_hook = 1;
+	record(ptr ? 'r' : 'a', p, ptr, size);
+	in_hook = 0;
+    }
+    return p;
+}
+
+int posix_memalign(void **pp, size_t align, size_t size)
+{
+    int err;
+
+    lookup();
+    err = real_posix_memalign(pp, align, size);
+    if (err == 0 && size && TRACED()) {
+	in_hook = 1;
+	record('a', *pp, NULL, size);
+	in_hook = 0;
+    }
+    return err;
+}
+
+void *memalign(size_t align, size_t size)
+{
+    void *p;
+
+    lookup();
+    p = real_memalign(align, size);
+    if (p && size && TRACED()) {
+	in_hook = 1;
+	record('a', p, NULL, size);
+	in_hook = 0;
+    }
+    return p;
+}
+
+void *aligned_alloc(size_t align, size_t size)
+{
+    void *p;
+
+    lookup();
+    p = real_aligned_alloc(align, size);
+    if (p && size && TRACED()) {
+	in_hook = 1;
+	record('a', p, NULL, size);
+	in_hook = 0;
+    }
+    return p;
+}
+
+/*
+ * Flusher side: address-to-id hash table with linear probing
+ */
+#define HASH(p)  ((((size_t)(p) >> 4) * 0x9E3779B97F4A7C15UL) & (id_cap - 1))
+
+static size_t id_slot(void *p)
+{
+    size_t i = HASH(p);
+
+    while (id_addr[i] != NULL && id_addr[i] != p)
+	i = (i + 1) & (id_cap - 1);
+    return i;
+}
+
+static void id_grow(void)
+{
+    void **old_addr = id_addr;
+    int *old_id = id_of;
+    size_t old_cap = id_cap, i, j;
+
+    id_cap = id_cap ? 2 * id_cap : 1024;
+    id_addr = calloc(id_cap, sizeof(void *));
+    id_of = malloc(id_cap * sizeof(int));
+    if (id_addr == NULL || id_of == NULL) {
+	fprintf(stderr, "mmtrace: out of memory\n");
+	exit(1);
+    }
+    for (i = 0; i < old_cap; i++)
+	if (old_addr[i] != NULL) {
+	    j = id_slot(old_addr[i]);
+	    id_addr[j] = old_addr[i];
+	    id_of[j] = old_id[i];
+	}
+    free(old_addr);
+    free(old_id);
+}
+
+/*
+ * id_new - A free id: a released one if there is any, else a new one
+ */
+static int id_new(void)
+{
+    if (nfree_ids)
+	return free_ids[--nfree_ids];
+    if (num_ids == id_size_cap) {
+	id_size_cap = id_size_cap ? 2 * id_size_cap : 1024;
+	if ((id_size = realloc(id_size, id_size_cap * sizeof(size_t))) == NULL ||
+	    (free_ids = realloc(free_ids, id_size_cap * sizeof(int))) == NULL) {
+	    fprintf(stderr, "mmtrace: out of memory\n");
+	    exit(1);
+	}
+    }
+    return num_ids++;
+}
+
+/*
+ * id_put - Make id the id of live address p, a block of size bytes
+ */
+static int id_put(void *p, size_t size, int id)
+{
+    size_t i;
+
+    if (2 * (id_live + 1) > id_cap)
+	id_grow();
+    i = id_slot(p);
+    id_addr[i] = p;
+    id_of[i] = id;
+    id_live++;
+    id_size[id] = size;
+    live_bytes += size;
+    if (live_bytes > peak_bytes)
+	peak_bytes = live_bytes;
+    return id;
+}
+
+/*
+ * id_take - Remove live address p and return its id, or -1 if p is
+ *     not live. The id is not free for reuse until id_release.
+ */
+static int id_take(void *p)
+{
+    size_t i, j, k;
+    int id;
+
+    if (id_cap == 0 || id_addr[i = id_slot(p)] == NULL)
+	return -1;
+    id = id_of[i];
+    id_live--;
+    live_bytes -= id_size[id];
+    /* backward-shift deletion keeps the probe sequences intact */
+    for (j = i; ; ) {
+	id_addr[i] = NULL;
+	do {
+	    j = (j + 1) & (id_cap - 1);
+	    if (id_addr[j] == NULL)
+		return id;
+	    k = HASH(id_addr[j]);
+	} while (i <= j ? (i < k && k <= j) : (i < k || k <= j));
+	id_addr[i] = id_addr[j];
+	id_of[i] = id_of[j];
+	i = j;
+    }
+}
+
+static void id_release(int id)
+{
+    free_ids[nfree_ids++] = id;
+}
+
+/*
+ * write_rec - Write one record as a trace op
+ */
+static void write_rec(rec_t *rec)
+{
+    int id, old;
+
+    switch (rec->type) {
+    case 'a':
+	if ((old = id_take(rec->ptr)) >= 0) {   /* its free raced past us */
+	    fprintf(out, "f %d\n", old);
+	    id_release(old);
+	    num_ops++;
+	}
+	fprintf(out, "a %d %lu\n", id_put(rec->ptr, rec->size, id_new()),
+		(unsigned long)rec->size);
+	break;
+    case 'r':
+	if ((old = id_take(rec->old)) < 0) {    /* not ours: a fresh block */
+	    rec->type = 'a';
+	    write_rec(rec);
+	    return;
+	}
+	if (rec->ptr != rec->old && (id = id_take(rec->ptr)) >= 0) {
+	    fprintf(out, "f %d\n", id);
+	    id_release(id);
+	    num_ops++;
+	}
+	fprintf(out, "r %d %lu\n", old, (unsigned long)rec->size);
+	id_put(rec->ptr, rec->size, old);      /* same id, maybe new address */
+	break;
+    case 'f':
+	if ((id = id_take(rec->ptr)) < 0)
+	    return;
+	fprintf(out, "f %d\n", id);
+	id_release(id);
+	break;
+    }
+    num_ops++;
+}
+
+/*
+ * flush - Write out the records of all rings in sequence order. A
+ *     gap in the sequence is a call that has not reached its ring yet,
+ *     so stop there unless told to take whatever is available. Caller
+ *     holds flush_lock.
+ */
+static void flush(int all)
+{
+    ring_t *r, *best;
+    rec_t *rec;
+
+    for (;;) {
+	best = NULL;
+	for (r = __atomic_load_n(&rings, __ATOMIC_ACQUIRE); r; r = r->next)
+	    if (r->tail != __atomic_load_n(&r->head, __ATOMIC_ACQUIRE) &&
+		(best == NULL || r->recs[r->tail & (RING_SIZE-1)].seq <
+		 best->recs[best->tail & (RING_SIZE-1)].seq))
+		best = r;
+	if (best == NULL)
+	    return;
+	rec = &best->recs[best->tail & (RING_SIZE-1)];
+	if (rec->seq != done_seq && !all)
+	    return;
+	write_rec(rec);
+	done_seq = rec->seq + 1;
+	__atomic_store_n(&best->tail, best->tail + 1, __ATOMIC_RELEASE);
+    }
+}
+
+static void *flusher_main(void *arg)
+{
+    unsigned long last = 0;
+    int stalled = 0;
+
+    in_hook = 1;    /* nothing this thread allocates is traced */
+    while (!stopping) {
+	usleep(FLUSH_USECS);
+	pthread_mutex_lock(&flush_lock);
+	flush(stalled >= MAX_STALL);
+	pthread_mutex_unlock(&flush_lock);
+	stalled = (done_seq == last) ? stalled + 1 : 0;
+	last = done_seq;
+    }
+    return NULL;
+}
+
+/*
+ * ring_exit - Destructor of ring_key: write out what is left in an
+ *     exiting thread's ring, then take the ring off the list and unmap
+ *     it. Once tracing has stopped its records are dropped.
+ */
+static void ring_exit(void *arg)
+{
+    ring_t *r = arg, **pp;
+    int stalled = 0;
+
+    in_hook = 1;
+    pthread_mutex_lock(&flush_lock);
+    while (out != NULL && r->tail != r->head) {
+	flush(stalled++ >= MAX_STALL);
+	if (r->tail == r->head)
+	    break;
+	pthread_mutex_unlock(&flush_lock);
+	sched_yield();
+	pthread_mutex_lock(&flush_lock);
+    }
+    for (pp = &rings; *pp != r; pp = &(*pp)->next)
+	;
+    *pp = r->next;
+    pthread_mutex_unlock(&flush_lock);
+    my_ring = NULL;
+    munmap(r, sizeof(ring_t));
+    in_hook = 0;
+}
+
+/*
+ * write_header - (Re)write the four header numbers, padded to a fixed
+ *     width so that the final counts fit over the placeholders
+ */
+static void write_header(void)
+{
+    rewind(out);
+    fprintf(out, "%20lu\n%20d\n%20ld\n%20d\n",
+	    (unsigned long)peak_bytes, num_ids, num_ops, 1);
+}
+
+static void atfork_child(void)
+{
+    tracing = 0;
+    out = NULL;
+    pthread_mutex_init(&flush_lock, NULL);   /* its holder is gone */
+}
+
+static void init(void)
+{
+    char name[64], *path;
+
+    lookup();
+    in_hook = 1;
+    if ((path = getenv("MMTRACE_FILE")) == NULL) {
+	sprintf(name, "mmtrace.%d.rep", (int)getpid());
+	path = name;
+    }
+    if ((out = fopen(path, "w")) == NULL) {
+	perror("mmtrace: fopen");
+	in_hook = 0;
+	return;
+    }
+    write_header();
+    pthread_atfork(NULL, NULL, atfork_child);
+    if (pthread_key_create(&ring_key, ring_exit) != 0 ||
+	pthread_create(&flusher, NULL, flusher_main, NULL) != 0) {
+	fclose(out);
+	out = NULL;
+	in_hook = 0;
+	return;
+    }
+    tracing = 1;
+    in_hook = 0;
+}
+
+static void fini(void)
+{
+    if (out == NULL)
+	return;
+    in_hook = 1;
+    tracing = 0;
+    stopping = 1;
+    pthread_join(flusher, NULL);
+    pthread_mutex_lock(&flush_lock);
+    flush(1);
+    write_header();
+    fclose(out);
+    out = NULL;
+    pthread_mutex_unlock(&flush_lock);
+}
@@ -0,0 +1,154 @@
+/*
+ * mmvariants.c - Several compile-time variants of mm.c in one mdriver.
+ *
+ *   unix> make mdriver-variants
+ *   unix> mdriver-variants -K
+ *
+ * The Makefile compiles mm.c once for each name in VARIANTS, with the
+ * flags in VFLAGS_<name> (e.g. -DALIGNMENT=32 or -DSL_BITS=3) and with
+ * -DMM_PREFIX=<name>_, under which mm.h renames the package's globals
+ * <name>_mm_init, <name>_mm_malloc, ... Each build is specialized at
+ * compile time like mm.c itself: its constants fold into its code.
+ *
+ * This file is the mm package mdriver sees: it defines mm_init,
+ * mm_malloc, ... to call the current variant, the first one until
+ * mm_set_variant picks another. Every variant pays the same one
+ * indirect call per op, so their throughputs compare fairly among
+ * themselves, if not quite with plain mdriver.
+ */
+#include <stdio.h>
+
+#include "mm.h"
+
+/* The variants to link in, as VARIANT(name) VARIANT(name) ... */
+#ifndef VARIANTS
+#define VARIANTS VARIANT(base)
+#endif
+
+/* Team structure */
+team_t team = {
+    /* Team name */
+    "variants",
+    /* First member's full name */
+    "Harry Bovik",
+    /* First member's email address */
+    "bovik@cs.cmu.edu",
+    /* Second member's full name (leave blank if none) */
+    "",
+    /* Second member's email address (leave blank if none) */
+    ""
+};
+
+/* The interface of each variant */
+#define VARIANT(v)							\
+    extern int v##_mm_init(void);					\
+    extern void *v##_mm_malloc(size_t size);				\
+    extern void v##_mm_free(void *ptr);					\
+    extern void *v##_mm_realloc(void *ptr, size_t size);		\
+    extern int v##_mm_malloc_batch(size_t size, int n, void **out);	\
+    extern void v##_mm_free_batch(void **ptrs, int n);			\
+    extern void *v##_mm_memalign(size_t align, size_t size);		\
+    extern size_t v##_mm_usable_size(void *ptr);			\
+    extern void v##_mm_snapshot(mm_snap_t *snap);			\
+    extern int v##_mm_set_policy(int policy, int k);
+VARIANTS
+#undef VARIANT
+
+typedef struct {
+    char *name;
+    int (*init)(void);
+    void *(*malloc)(size_t size);
+    void (*free)(void *ptr);
+    void *(*realloc)(void *ptr, size_t size);
+    int (*malloc_batch)(size_t size, int n, void **out);
+    void (*free_batch)(void **ptrs, int n);
+    void *(*memalign)(size_t align, size_t size);
+    size_t (*usable_size)(void *ptr);
+    void (*snapshot)(mm_snap_t *snap);
+    int (*set_policy)(int policy, int k);
+} variant_t;
+
+static variant_t variants[] = {
+#define VARIANT(v)							\
+    {#v, v##_mm_init, v##_mm_malloc, v##_mm_free, v##_mm_realloc,	\
+     v##_mm_malloc_batch, v##_mm_free_batch, v##_mm_memalign,		\
+     v##_mm_usable_size, v##_mm_snapshot, v##_mm_set_policy},
+    VARIANTS
+#undef VARIANT
+};
+
+#define NVARIANTS  ((int)(sizeof(variants) / sizeof(variants[0])))
+
+static variant_t *cur = variants;   /* the variant the mm_* calls go to */
+
+/*
+ * mm_variant_name - Name of variant v, or NULL if there is none
+ */
+char *mm_variant_name(int v)
+{
+    return (v >= 0 && v < NVARIANTS) ? variants[v].name : NULL;
+}
+
+/*
+ * mm_set_variant - Send the mm_* calls to variant v from now on.
+ *     Returns -1 if there is no such variant.
+ */
+int mm_set_variant(int v)
+{
+    if (v < 0 || v >= NVARIANTS)
+	return -1;
+    cur = &variants[v];
+    return 0;
+}
+
+/* The mm interface, on the current variant */
+
+int mm_init(void)
+{
+    return cur->init();
+}
+
+void *mm_malloc(size_t size)
+{
+    return cur->malloc(size);
+}
+
+void mm_free(void *ptr)
+{
+    cur->free(ptr);
+}
+
+void *mm_realloc(void *ptr, size_t size)
+{
+    return cur->realloc(ptr, size);
+}
+
+int mm_malloc_batch(size_t size, int n, void **out)
+{
+    return cur->malloc_batch(size, n, out);
+}
+
+void mm_free_batch(void **ptrs, int n)
+{
+    cur->free_batch(ptrs, n);
+}
+
+void *mm_memalign(size_t align, size_t size)
+{
+    return cur->memalign(align, size);
+}
+
+size_t mm_usable_size(void *ptr)
+{
+    return cur->usable_size(ptr);
+}
+
+void mm_snapshot(mm_snap_t *snap)
+{
+    cur->snapshot(snap);
+}
+
+int mm_set_policy(int policy, int k)
+{
+    return cur->set_policy(policy, k);
+}
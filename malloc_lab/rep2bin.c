@@ -0,0 +1,99 @@
+/*
+ * rep2bin.c - Convert a .rep trace file into the binary trace format
+ *             of trace.h, which mdriver maps instead of parsing.
+ *
+ * usage: rep2bin <in.rep> [<out>]
+ *
+ * The output file defaults to the input name with its .rep suffix
+ * replaced by .bin. The result can be given to mdriver with -f, or
+ * listed in DEFAULT_TRACEFILES like any .rep file.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "trace.h"
+
+#define MAXLINE 1024
+
+static void die(char *msg, char *path)
+{
+    fprintf(stderr, "rep2bin: %s %s\n", msg, path);
+    exit(1);
+}
+
+int main(int argc, char **argv)
+{
+    FILE *in, *out;
+    char outpath[MAXLINE], type[MAXLINE];
+    bintrace_hdr_t hdr;
+    traceop_t *ops;
+    unsigned index, size, max_index = 0;
+    int i, n;
+
+    if (argc != 2 && argc != 3) {
+	fprintf(stderr, "usage: rep2bin <in.rep> [<out>]\n");
+	exit(1);
+    }
+    if (argc == 3)
+	strcpy(outpath, argv[2]);
+    else {
+	if (strlen(argv[1]) + 5 > MAXLINE)
+	    die("name too long:", argv[1]);
+	strcpy(outpath, argv[1]);
+	n = strlen(outpath);
+	if (n > 4 && !strcmp(outpath + n - 4, ".rep"))
+	    outpath[n - 4] = '\0';
+	strcat(outpath, ".bin");
+    }
+
+    if ((in = fopen(argv[1], "r")) == NULL)
+	die("could not open", argv[1]);
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, BINTRACE_MAGIC, 4);
+    hdr.version = BINTRACE_VERSION;
+    if (fscanf(in, "%d %d %d %d", &hdr.sugg_heapsize, &hdr.num_ids,
+	       &hdr.num_ops, &hdr.weight) != 4 || hdr.num_ops < 0)
+	die("bad header in", argv[1]);
+    if ((ops = calloc(hdr.num_ops ? hdr.num_ops : 1, sizeof(traceop_t))) == NULL)
+	die("out of memory reading", argv[1]);
+
+    /* Same parse as read_trace in mdriver.c */
+    for (i = 0; fscanf(in, "%s", type) != EOF; i++) {
+	if (i == hdr.num_ops)
+	    die("more ops than the header says in", argv[1]);
+	size = 0;
+	switch (type[0]) {
+	case 'a':
+	    fscanf(in, "%u %u", &index, &size);
+	    ops[i].type = ALLOC;
+	    break;
+	case 'r':
+	    fscanf(in, "%u %u", &index, &size);
+	    ops[i].type = REALLOC;
+	    break;
+	case 'f':
+	    fscanf(in, "%u", &index);
+	    ops[i].type = FREE;
+	    break;
+	default:
+	    die("bogus type character in", argv[1]);
+	}
+	ops[i].index = index;
+	ops[i].size = size;
+	if (index > max_index)
+	    max_index = index;
+    }
+    fclose(in);
+    if (i != hdr.num_ops || (hdr.num_ops && max_index >= (unsigned)hdr.num_ids))
+	die("ops do not match the header in", argv[1]);
+
+    if ((out = fopen(outpath, "wb")) == NULL)
+	die("could not create", outpath);
+    if (fwrite(&hdr, sizeof(hdr), 1, out) != 1 ||
+	fwrite(ops, sizeof(traceop_t), hdr.num_ops, out) != (size_t)hdr.num_ops ||
+	fclose(out) != 0)
+	die("could not write", outpath);
+    free(ops);
+    return 0;
+}
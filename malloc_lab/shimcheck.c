@@ -0,0 +1,74 @@
+/*
+ * shimcheck.c - Smoke check of mmshim.so on requests too large for the
+ *               heap.
+ *
+ *   unix> make check-shim
+ *
+ * which runs "LD_PRELOAD=./mmshim.so ./shimcheck". One large malloc,
+ * calloc and realloc must each either fail with ENOMEM or return a
+ * block with room for the whole request, which is then written at its
+ * first and last byte. Exits 1, naming the call, if one does neither.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <malloc.h>
+
+#define BIG  ((1UL << 36) + 16)    /* 64 GB and a bit: past any mm.c heap */
+
+static int failed;
+
+/*
+ * check - Check the result p of a request for size bytes by call
+ */
+static void check(char *call, char *p, size_t size)
+{
+    if (p == NULL) {
+	if (errno != ENOMEM) {
+	    printf("shimcheck: %s failed with errno %d, not ENOMEM\n", call, errno);
+	    failed = 1;
+	}
+	return;
+    }
+    if (malloc_usable_size(p) < size) {
+	printf("shimcheck: %s(%lu) returned a block of %lu bytes\n", call,
+	       (unsigned long)size, (unsigned long)malloc_usable_size(p));
+	failed = 1;
+	return;
+    }
+    p[0] = p[size - 1] = 1;
+}
+
+int main(void)
+{
+    char *p, *q;
+
+    errno = 0;
+    p = malloc(BIG);
+    check("malloc", p, BIG);
+    free(p);
+
+    errno = 0;
+    p = calloc(1, BIG);
+    check("calloc", p, BIG);
+    free(p);
+
+    if ((p = malloc(100)) == NULL) {
+	printf("shimcheck: malloc(100) failed\n");
+	return 1;
+    }
+    strcpy(p, "shimcheck");
+    errno = 0;
+    q = realloc(p, BIG);
+    check("realloc", q, BIG);
+    if (q == NULL && strcmp(p, "shimcheck") != 0) {
+	printf("shimcheck: failed realloc did not keep the block\n");
+	failed = 1;
+    }
+    free(q ? q : p);
+
+    if (!failed)
+	printf("shimcheck: ok\n");
+    return failed;
+}
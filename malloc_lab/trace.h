@@ -0,0 +1,32 @@
+/*
+ * trace.h - Trace operations and the binary trace format
+ *
+ * A binary trace is a bintrace_hdr_t followed by num_ops traceop_t
+ * records, exactly as they are laid out in memory, so mdriver can map
+ * the file and replay the records in place. The header carries the
+ * same four numbers as the header of a .rep file. Binary traces use
+ * the byte order of the machine that wrote them; rep2bin makes them
+ * from .rep files.
+ */
+#define BINTRACE_MAGIC    "MMTR"
+#define BINTRACE_VERSION  1
+
+/* Types of trace operations */
+enum {ALLOC, FREE, REALLOC};
+
+/* Characterizes a single trace operation (allocator request) */
+typedef struct {
+    int type;                         /* type of request */
+    int index;                        /* index for free() to use later */
+    int size;                         /* byte size of alloc/realloc request */
+} traceop_t;
+
+/* The header of a binary trace file */
+typedef struct {
+    char magic[4];       /* BINTRACE_MAGIC, not null-terminated */
+    int version;         /* BINTRACE_VERSION */
+    int sugg_heapsize;   /* suggested heap size (unused) */
+    int num_ids;         /* number of alloc/realloc ids */
+    int num_ops;         /* number of traceop_t records that follow */
+    int weight;          /* weight for this trace (unused) */
+} bintrace_hdr_t;